@@ -0,0 +1,126 @@
+/*
+CA - OpenMP
+arenagg_p.c
+Arena allocator used in gengroups_p.c program
+
+All the memory of a run is reserved at once, with 2 MB huge pages when the system has them
+(explicit huge pages with MAP_HUGETLB first, then transparent huge pages with madvise, then normal
+pages), so the hot loops take less TLB misses and page faults. Allocations are a bump pointer
+(atomic, so tasks can allocate at the same time); memory is given back by going back to a mark.
+Every thread gets its own scratch sub-arena for temporary buffers.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+#define HUGEPAGE (2 * 1024 * 1024)
+#define ALIGN    64	// every allocation starts in a new cache line
+
+/* 1 - Functions to create and destroy an arena
+   Input:   size    bytes to reserve (rounded up to a multiple of 2 MB)
+   Output:  ar      arena, empty
+***************************************************************************************************/
+void arenainit(struct arena *ar, size_t size)
+{
+	size = (size + HUGEPAGE - 1) / HUGEPAGE * HUGEPAGE;
+
+	ar->used = 0;
+	ar->peak = 0;
+	ar->size = size;
+	ar->sub = 0;
+
+	// explicit huge pages, only if the administrator has reserved them
+	ar->huge = 2;
+	ar->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (ar->base == MAP_FAILED)
+	{
+		char *map;
+		size_t head;
+
+		ar->huge = 0;
+		map = mmap(NULL, size + HUGEPAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (map == MAP_FAILED)
+		{
+			printf("Error: can not reserve %zu MB of memory \n", size >> 20);
+			exit(-1);
+		}
+		// 2 MB more than needed, and the parts before the first 2 MB boundary and after the arena are
+		// given back: every 2 MB of the arena can be a transparent huge page
+		head = (HUGEPAGE - (uintptr_t)map % HUGEPAGE) % HUGEPAGE;
+		if (head > 0)
+			munmap(map, head);
+		if (HUGEPAGE - head > 0)
+			munmap(map + head + size, HUGEPAGE - head);
+		ar->base = map + head;
+		if (madvise(ar->base, size, MADV_HUGEPAGE) == 0)
+			ar->huge = 1;
+	}
+}
+
+void arenadestroy(struct arena *ar)
+{
+	if (!ar->sub)
+		munmap(ar->base, ar->size);
+	ar->base = NULL;
+}
+
+/* 2 - Function to allocate memory from an arena
+   Input:   bytes   size of the block
+   Output:  block, aligned to a cache line
+***************************************************************************************************/
+void *arenaalloc(struct arena *ar, size_t bytes)
+{
+	size_t aligned = (bytes + ALIGN - 1) / ALIGN * ALIGN;
+	size_t offset = __atomic_fetch_add(&ar->used, aligned, __ATOMIC_RELAXED);
+	size_t end = offset + aligned, peak = __atomic_load_n(&ar->peak, __ATOMIC_RELAXED);
+
+	if (end > ar->size)
+	{
+		printf("Error: arena full (%zu MB reserved, %zu MB asked) \n", ar->size >> 20, end >> 20);
+		exit(-1);
+	}
+	while ((end > peak) && !__atomic_compare_exchange_n(&ar->peak, &peak, end, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	return ar->base + offset;
+}
+
+/* 3 - Functions to free the blocks allocated after a mark (only when no other thread uses the arena)
+***************************************************************************************************/
+size_t arenamark(struct arena *ar)
+{
+	return ar->used;
+}
+
+void arenarelease(struct arena *ar, size_t mark)
+{
+	ar->used = mark;
+}
+
+/* 4 - Function to create a sub-arena (scratch of a thread) inside an arena
+   Input:   ar      arena
+            size    bytes of the sub-arena
+   Output:  sub     sub-arena, with the same kind of pages
+***************************************************************************************************/
+void arenasub(struct arena *ar, struct arena *sub, size_t size)
+{
+	sub->size = (size + ALIGN - 1) / ALIGN * ALIGN;
+	sub->base = arenaalloc(ar, sub->size);
+	sub->used = 0;
+	sub->peak = 0;
+	sub->huge = ar->huge;
+	sub->sub = 1;
+}
+
+/* 5 - Function to get the peak of memory used since the last call (the peak starts again from now)
+***************************************************************************************************/
+size_t arenapeak(struct arena *ar)
+{
+	size_t peak = ar->peak;
+
+	ar->peak = ar->used;
+	return peak;
+}
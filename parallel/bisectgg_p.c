@@ -0,0 +1,213 @@
+/*
+CA - OpenMP
+bisectgg_p.c
+Bisecting (divisive) Phase 1 used in gengroups_p.c program (option -b)
+
+Instead of NGROUPS centroids for every element in every iteration (O(n x K) per pass), the
+elements are split in 2 with 2-means, and each half is split again, until there are NGROUPS
+leaves (O(n x log K) in total). Every node gets a number of leaves, and gives them to its two
+halves in proportion to their sizes. The two halves of a node are independent, so each subtree
+is a task; the 2-means of a big node is split in chunk tasks, whose sums are added in chunk order.
+Leaves get the groups in tree order, and their centroid is the average of their elements, as
+in Lloyd. Without random numbers, the result does not depend on the number of threads.
+Optionally, a few flat Lloyd iterations refine the result (see lloydgg_p.c).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+struct bisecttree          // data shared by all the nodes
+{
+ float        **elems;
+ int           *idx;       // elements of each node: idx[first .. first + n), reordered by the splits
+ unsigned char *side;      // half of each element in the split of its node
+ float        (*cent)[NFEAT];
+ gindex        *grind;
+ int            nsplits, niter;
+};
+
+// Sums of one chunk of a node: additions of each half (last value: number of elements)
+static void chunksums(struct bisecttree *bt, int first, int n, float c[2][NFEAT], double add[2][NFEAT + 1])
+{
+	double min_d;
+
+	memset(add, 0, 2 * (NFEAT + 1) * sizeof(double));
+	for (int k = first; k < first + n; k++)
+	{
+		float *e = bt->elems[bt->idx[k]];
+		int s = nearestcentroid(e, c, 2, &min_d);
+
+		bt->side[bt->idx[k]] = s;
+		for (int j = 0; j < NFEAT; j++)
+			add[s][j] += e[j];
+		add[s][NFEAT]++;
+	}
+}
+
+// 2-means of the elements idx[first .. first + n); returns the size of the first half, that is
+// moved to the beginning
+static int twomeans(struct bisecttree *bt, int first, int n)
+{
+	int nch = (n + BISECTCHUNK - 1) / BISECTCHUNK, finish = 0, it = 0, a = 0, b = 0, i, j;
+	double (*part)[2][NFEAT + 1] = malloc(nch * sizeof(*part)); // not from the arena: the nodes run at the same time
+	double add[2][NFEAT + 1], d, far;
+	float c[2][NFEAT], mean[NFEAT];
+
+	// first centroids: the element farthest from the mean, and the element farthest from it
+	memset(add, 0, sizeof(add));
+	for (i = first; i < first + n; i++)
+		for (j = 0; j < NFEAT; j++)
+			add[0][j] += bt->elems[bt->idx[i]][j];
+	for (j = 0; j < NFEAT; j++)
+		mean[j] = add[0][j] / n;
+	for (i = first, far = -1.0; i < first + n; i++)
+		if ((d = geneticdistance(bt->elems[bt->idx[i]], mean)) > far)
+		{
+			far = d;
+			a = bt->idx[i];
+		}
+	for (i = first, far = -1.0; i < first + n; i++)
+		if ((d = geneticdistance(bt->elems[bt->idx[i]], bt->elems[a])) > far)
+		{
+			far = d;
+			b = bt->idx[i];
+		}
+	memcpy(c[0], bt->elems[a], sizeof(c[0]));
+	memcpy(c[1], bt->elems[b], sizeof(c[1]));
+
+	while ((finish == 0) && (it < MAXIT))
+	{
+		// [*] chunks of a big node as tasks; their sums are added in chunk order
+		for (int ch = 0; ch < nch; ch++)
+		{
+			int cf = first + ch * BISECTCHUNK;
+			int cn = (ch == nch - 1) ? first + n - cf : BISECTCHUNK;
+
+			#pragma omp task default(none) shared(bt, c, part) firstprivate(ch, cf, cn) if(nch > 1)
+			chunksums(bt, cf, cn, c, part[ch]);
+		}
+		#pragma omp taskwait
+
+		memset(add, 0, sizeof(add));
+		for (int ch = 0; ch < nch; ch++)
+			for (int s = 0; s < 2; s++)
+				for (j = 0; j < NFEAT + 1; j++)
+					add[s][j] += part[ch][s][j];
+
+		finish = 1;
+		for (int s = 0; s < 2; s++)
+			if ((add[s][NFEAT] > 0) && (movecentroid(add[s], c[s]) > DELTA))
+				finish = 0;
+		it++;
+	}
+
+	free(part);
+	#pragma omp atomic
+	bt->niter += it;
+
+	// all the elements are equal: any split is good
+	if ((add[0][NFEAT] == 0) || (add[1][NFEAT] == 0))
+	{
+		for (i = first; i < first + n; i++)
+			bt->side[bt->idx[i]] = (i - first) >= n / 2;
+	}
+
+	// first half to the beginning (two pointers)
+	i = first;
+	j = first + n - 1;
+	while (i <= j)
+	{
+		if (bt->side[bt->idx[i]] == 0)
+			i++;
+		else
+		{
+			int aux = bt->idx[i];
+			bt->idx[i] = bt->idx[j];
+			bt->idx[j] = aux;
+			j--;
+		}
+	}
+	return i - first;
+}
+
+// Node of the tree: elements idx[first .. first + n), groups g0 .. g0 + leaves - 1
+static void bisectnode(struct bisecttree *bt, int first, int n, int g0, int leaves)
+{
+	int nl, ll;
+
+	if ((leaves == 1) || (n < 2))
+	{
+		// leaf: all the elements to group g0 (the other groups of the node stay empty)
+		double add[NFEAT + 1];
+
+		memset(add, 0, sizeof(add));
+		for (int k = first; k < first + n; k++)
+		{
+			bt->grind[bt->idx[k]] = g0;
+			for (int j = 0; j < NFEAT; j++)
+				add[j] += bt->elems[bt->idx[k]][j];
+			add[NFEAT]++;
+		}
+		if (n > 0)
+			movecentroid(add, bt->cent[g0]);
+		return;
+	}
+
+	nl = twomeans(bt, first, n);
+	#pragma omp atomic
+	bt->nsplits++;
+
+	// leaves in proportion to the sizes, at least one for each half
+	ll = (int)((double)leaves * nl / n + 0.5);
+	if (ll < 1)
+		ll = 1;
+	if (ll > leaves - 1)
+		ll = leaves - 1;
+
+	// [*] the two subtrees are independent; small ones are not worth a task
+	#pragma omp task default(none) shared(bt) firstprivate(first, nl, g0, ll) if(nl > BISECTCHUNK)
+	bisectnode(bt, first, nl, g0, ll);
+	#pragma omp task default(none) shared(bt) firstprivate(first, n, nl, g0, ll, leaves) if(n - nl > BISECTCHUNK)
+	bisectnode(bt, first + nl, n - nl, g0 + ll, leaves - ll);
+	#pragma omp taskwait
+}
+
+/* 1 - Function to classify the elements with bisecting k-means
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            cent    first centroids (NGROUPS x NFEAT), kept for the groups that end empty
+            ar      arena for the vectors of the tree
+   Output:  cent    centroids of the leaves
+            grind   group of each element
+            nsplits, niter: number of 2-means and of their iterations
+***************************************************************************************************/
+void bisect(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct arena *ar, int *nsplits, int *niter)
+{
+	struct bisecttree bt;
+	size_t mark = arenamark(ar);
+
+	bt.elems = elems;
+	bt.cent = cent;
+	bt.grind = grind;
+	bt.nsplits = bt.niter = 0;
+	bt.idx = (int *)arenaalloc(ar, nelems * sizeof(int));
+	bt.side = (unsigned char *)arenaalloc(ar, nelems);
+
+	#pragma omp parallel for
+	for (int i = 0; i < nelems; i++)
+		bt.idx[i] = i;
+
+	#pragma omp parallel default(none) shared(bt, nelems)
+	#pragma omp single
+	bisectnode(&bt, 0, nelems, 0, NGROUPS);
+
+	*nsplits = bt.nsplits;
+	*niter = bt.niter;
+	arenarelease(ar, mark);
+}
@@ -0,0 +1,170 @@
+/*
+CA - OpenMP
+coregg_p.c
+Coreset mode used in gengroups_p.c program (option -m)
+
+For quick analyses, Phase 1 runs on a weighted sample of about m elements (a coreset) instead of
+all of them. The sample is the lightweight coreset of Bachem et al.: element x is chosen with a
+probability that mixes the uniform one and its share of the squared distances to the mean,
+  q(x) = 1/2 1/n + 1/2 d(x, mean)^2 / sum d^2
+so the far elements (the small groups) are not lost, and its weight is the number of elements it
+stands for, 1 / (m q(x)). The sampling is one parallel pass: each element is chosen independently
+with probability min(1, m q(x)), with a random number that only depends on its index, so the
+coreset is the same with any number of threads. The weighted coreset is clustered with lloyd,
+every element is assigned to the nearest final centroid in one more pass, and Phase 2 is as usual.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define CORESEED 147	//seed of the sampling
+
+// Random number in [0, 1) of element i (splitmix64 of the seed and the index)
+static double elemrandom(int i)
+{
+	unsigned long long z = (unsigned long long)CORESEED * 0x9E3779B97F4A7C15ULL + (unsigned long long)i * 0xBF58476D1CE4E5B9ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+	return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* 1 - Function to build the weighted coreset of the elements
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            m       expected size of the coreset
+            ar      arena for the coreset (kept until the end of the run)
+   Output:  cs      elements of the coreset (pointers to the rows of elems) and their weights;
+                    cs->grind has space for their groups
+***************************************************************************************************/
+void coreset(int nelems, float **elems, int m, struct coreset *cs, struct arena *ar)
+{
+	int nblocks = (nelems + DETBLOCK - 1) / DETBLOCK, b;
+	size_t mark = arenamark(ar);
+	double (*bsum)[NFEAT + 1] = arenaalloc(ar, nblocks * sizeof(*bsum)); // per block: sums, then sum of d^2
+	int *bcount = (int *)arenaalloc(ar, (nblocks + 1) * sizeof(int));
+	float *dist = (float *)arenaalloc(ar, nelems * sizeof(float));
+	float mean[NFEAT];
+	double add[NFEAT + 1], total = 0.0;
+	int j;
+
+	// mean and sum of the squared distances to it, by blocks added in order (same result with any
+	// number of threads, as the sample)
+	#pragma omp parallel for default(none) shared(nelems, elems, nblocks, bsum) private(j)
+	for (b = 0; b < nblocks; b++)
+	{
+		memset(bsum[b], 0, sizeof(bsum[b]));
+		for (int i = b * DETBLOCK; (i < nelems) && (i < (b + 1) * DETBLOCK); i++)
+			for (j = 0; j < NFEAT; j++)
+				bsum[b][j] += elems[i][j];
+	}
+	memset(add, 0, sizeof(add));
+	for (b = 0; b < nblocks; b++)
+		for (j = 0; j < NFEAT; j++)
+			add[j] += bsum[b][j];
+	for (j = 0; j < NFEAT; j++)
+		mean[j] = add[j] / nelems;
+
+	#pragma omp parallel for default(none) shared(nelems, elems, nblocks, bsum, dist, mean)
+	for (b = 0; b < nblocks; b++)
+	{
+		bsum[b][NFEAT] = 0.0;
+		for (int i = b * DETBLOCK; (i < nelems) && (i < (b + 1) * DETBLOCK); i++)
+		{
+			double d = geneticdistance(elems[i], mean);
+			dist[i] = d * d;
+			bsum[b][NFEAT] += d * d;
+		}
+	}
+	for (b = 0; b < nblocks; b++)
+		total += bsum[b][NFEAT];
+	if (total == 0.0)
+		total = 1.0; // all the elements are equal: uniform sampling
+
+	// [*] sampling: every element is decided alone; count of each block, then positions in element order
+	#pragma omp parallel for default(none) shared(nelems, nblocks, bcount, dist, total, m)
+	for (b = 0; b < nblocks; b++)
+	{
+		bcount[b + 1] = 0;
+		for (int i = b * DETBLOCK; (i < nelems) && (i < (b + 1) * DETBLOCK); i++)
+		{
+			double p = m * (0.5 / nelems + 0.5 * dist[i] / total);
+			if (elemrandom(i) < p)
+				bcount[b + 1]++;
+			else
+				dist[i] = -1.0f; // not chosen
+		}
+	}
+	bcount[0] = 0;
+	for (b = 0; b < nblocks; b++)
+		bcount[b + 1] += bcount[b];
+
+	cs->n = bcount[nblocks];
+	cs->elems = (float **)malloc(cs->n * sizeof(float *));
+	cs->weight = (float *)malloc(cs->n * sizeof(float));
+	cs->grind = (gindex *)malloc(cs->n * sizeof(gindex));
+
+	#pragma omp parallel for default(none) shared(nelems, elems, nblocks, bcount, dist, total, m, cs)
+	for (b = 0; b < nblocks; b++)
+	{
+		int k = bcount[b];
+		for (int i = b * DETBLOCK; (i < nelems) && (i < (b + 1) * DETBLOCK); i++)
+			if (dist[i] >= 0.0f)
+			{
+				double p = m * (0.5 / nelems + 0.5 * dist[i] / total);
+				cs->elems[k] = elems[i];
+				cs->weight[k] = (p < 1.0) ? 1.0 / p : 1.0;
+				k++;
+			}
+	}
+
+	arenarelease(ar, mark);
+}
+
+void coresetfree(struct coreset *cs)
+{
+	free(cs->elems);
+	free(cs->weight);
+	free(cs->grind);
+}
+
+/* 2 - Function to assign every element to the nearest centroid (after the coreset)
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            cent    centroids of the coreset
+   Output:  grind   group of each element
+            returns the inertia of the elements (sum of the squared distances to their centroid)
+***************************************************************************************************/
+double assignall(int nelems, float **elems, float cent[][NFEAT], gindex *grind)
+{
+	double inertia = 0.0, min_d;
+
+	#pragma omp parallel for default(none) shared(nelems, elems, cent, grind) private(min_d) reduction(+:inertia) schedule(runtime)
+	for (int i = 0; i < nelems; i++)
+	{
+		grind[i] = nearestcentroid(elems[i], cent, NGROUPS, &min_d);
+		inertia += min_d * min_d;
+	}
+	return inertia;
+}
+
+/* 3 - Function to get the weighted inertia of the coreset (estimate of the inertia of all the elements)
+***************************************************************************************************/
+double coresetinertia(struct coreset *cs, float cent[][NFEAT])
+{
+	double inertia = 0.0, d;
+
+	#pragma omp parallel for default(none) shared(cs, cent) private(d) reduction(+:inertia)
+	for (int k = 0; k < cs->n; k++)
+	{
+		d = geneticdistance(cs->elems[k], cent[cs->grind[k]]);
+		inertia += cs->weight[k] * d * d;
+	}
+	return inertia;
+}
@@ -0,0 +1,129 @@
+/*
+CA - OpenMP
+ensemblegg_p.c
+Multi-restart ensemble used in gengroups_p.c program (option -r)
+
+A single run from srand(147) can end in a poor local optimum. The ensemble runs nrest
+restarts (seeds 147, 148, ...) on the same elements. The restarts are interleaved: each
+iteration is one pass over the elements, and every element is classified for all the
+restarts still running while it is in cache. The restart with the lowest inertia wins.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+/* 1 - Function to run nrest restarts of Phase 1 and keep the best one
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            nrest   number of restarts
+   Output:  cent    centroids of the best restart
+            grind   group of each element in the best restart
+            rstats  seed, iterations and inertia of each restart (vector of size nrest)
+            returns the index of the best restart
+***************************************************************************************************/
+int ensemble(int nelems, float **elems, int nrest, float cent[][NFEAT], gindex *grind, struct restart *rstats)
+{
+	float (*rcent)[NGROUPS][NFEAT];  // centroids of each restart
+	gindex **rgrind;                  // classification of each restart
+	int *active;                      // restarts still running
+	double *add;                      // additions of each restart, nrest x NGROUPS x (NFEAT + 1)
+	size_t asize = (size_t)nrest * NGROUPS * (NFEAT + 1);
+	int nactive = nrest, niter = 0, finish, best, r;
+	double inertia, min_d;
+
+	rcent = malloc(nrest * sizeof(*rcent));
+	rgrind = (gindex **)calloc(nrest, sizeof(gindex *));
+	active = (int *)malloc(nrest * sizeof(int));
+	add = (double *)malloc(asize * sizeof(double));
+
+	for (r = 0; r < nrest; r++)
+	{
+		rstats[r].seed = 147 + r;
+		rstats[r].niter = 0;
+		initcentroids(rcent[r], rstats[r].seed);
+		rgrind[r] = (gindex *)malloc(nelems * sizeof(gindex));
+		active[r] = 1;
+	}
+
+	while ((nactive > 0) && (niter < MAXIT))
+	{
+		memset(add, 0, asize * sizeof(double));
+
+		// [*] one pass for all the restarts: the element is read once and used nrest times
+		// [*] add is a summation of all the restarts, reduction + over the whole array
+		#pragma omp parallel for default(none) shared(nelems, elems, nrest, rcent, rgrind, active) private(r, min_d) reduction(+:add[:asize])
+		for (int i = 0; i < nelems; i++)
+			for (r = 0; r < nrest; r++)
+				if (active[r])
+				{
+					int g = nearestcentroid(elems[i], rcent[r], NGROUPS, &min_d);
+					double *a = add + ((size_t)r * NGROUPS + g) * (NFEAT + 1);
+
+					rgrind[r][i] = g;
+					for (int j = 0; j < NFEAT; j++)
+						a[j] += elems[i][j];
+					a[NFEAT]++;
+				}
+		niter++;
+
+		// new centroids of the running restarts (NGROUPS x nrest, cheap)
+		for (r = 0; r < nrest; r++)
+			if (active[r])
+			{
+				finish = 1;
+				newcentroids((double (*)[NFEAT + 1])(add + (size_t)r * NGROUPS * (NFEAT + 1)), rcent[r], NULL, &finish);
+				rstats[r].niter = niter;
+				if (finish)
+				{
+					active[r] = 0;
+					nactive--;
+				}
+			}
+	}
+
+	// inertia of each restart with its final centroids
+	best = 0;
+	for (r = 0; r < nrest; r++)
+	{
+		inertia = 0.0;
+		#pragma omp parallel for default(none) shared(nelems, elems, rcent, rgrind, r) private(min_d) reduction(+:inertia)
+		for (int i = 0; i < nelems; i++)
+		{
+			min_d = geneticdistance(elems[i], rcent[r][rgrind[r][i]]);
+			inertia += min_d * min_d;
+		}
+		rstats[r].inertia = inertia;
+		if (inertia < rstats[best].inertia)
+			best = r;
+	}
+
+	memcpy(cent, rcent[best], sizeof(rcent[best]));
+	memcpy(grind, rgrind[best], nelems * sizeof(gindex));
+
+	for (r = 0; r < nrest; r++)
+		free(rgrind[r]);
+	free(rgrind);
+	free(rcent);
+	free(active);
+	free(add);
+
+	return best;
+}
+
+/* 2 - Function to write the statistics of the restarts in the results file
+***************************************************************************************************/
+void writerestarts(FILE *f2, struct restart *rstats, int nrest, int best)
+{
+	fprintf(f2, "\n\n Restarts (ensemble), best: %d\n\n", best);
+	fprintf(f2, "\n Rest.   Seed   Iter.         Inertia");
+	fprintf(f2, "\n ======================================\n");
+	for (int r = 0; r < nrest; r++)
+		fprintf(f2, "  %3d  %5u   %5d  %14.2f%s\n", r, rstats[r].seed, rstats[r].niter,
+				rstats[r].inertia, (r == best) ? " *" : "");
+}
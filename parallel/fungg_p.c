@@ -9,17 +9,9 @@ Routines used in gengroups_p.c program
 #include <math.h>
 #include <float.h>
 #include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
 #include <omp.h>
 
-// Merges two subarrays of arr[].
-// First subarray is arr[l..m]
-// Second subarray is arr[m+1..r]
-void merge(float arr[], int l, int m, int r);
-
-/* l is for left index and r is right index of the
-sub-array of arr to be sorted */
-void mergeSort(float arr[], int l, int r);
-
 /* 1 - Function to calculate the genetic distance; Euclidean distance between two elements.
        Input:   two elements of NFEAT characteristics (by reference)
        Output:  distance (double)
@@ -34,209 +26,146 @@ double geneticdistance(float *elem1, float *elem2)
 	return sqrt(distance);
 }
 
-/* 2 - Function to calculate the closest group (closest centroid) for each element.
-   Input:   nelems   number of elements, int
-            elems    matrix, with the information of the elements, of size nelems x NFEAT, by reference
-            cent    matrix, with the centroids, of size NGROUPS x NFEAT, by reference
-   Output:  grind   vector of size nelems, by reference, closest group for each element
+/* 2 - Function to calculate the closest centroid of one element
+   Input:   elem    element of NFEAT features, by reference
+            cent    matrix, with the centroids, of size k x NFEAT, by reference
+            k       number of centroids to check
+   Output:  index of the closest centroid (the first one if there is a tie), and its distance in min_d
 ***************************************************************************************************/
-void closestgroup(int nelems, float **elems, float cent[][NFEAT], int *grind)
+int nearestcentroid(float *elem, float cent[][NFEAT], int k, double *min_d)
 {
-	double min_d; // closest centroid value
-	int min_d_i;  // closest centroid index
-	double aux_d; // output of geneticdistance
-
-	// Iterate over all elements
-	// [*] Static scheduling, similar workload for each iteration
-    #pragma omp for nowait private(min_d, min_d_i, aux_d)
-	for (int i = 0; i < nelems; i++)
-	{
-		// Initialize the minimum distance
-		min_d = DBL_MAX;
+	int min_d_i = 0; // closest centroid index
+	double aux_d;    // output of geneticdistance
 
-		// For each element, get the distance with every centroid, and store the
-		// index of the centroid with closest distance
-		for (int j = 0; j < NGROUPS; j++)
+	// Initialize the minimum distance
+	*min_d = DBL_MAX;
+
+	// Get the distance with every centroid, and store the index of the centroid with closest distance
+	for (int j = 0; j < k; j++)
+	{
+		aux_d = geneticdistance(elem, cent[j]);
+		if (aux_d < *min_d)
 		{
-			aux_d = geneticdistance(elems[i], cent[j]);
-			if (aux_d < min_d)
-			{
-				min_d = aux_d;
-				min_d_i = j;
-			}
+			*min_d = aux_d;
+			min_d_i = j;
 		}
-
-		// Assign to the element i the closest centroid, stored in min
-		grind[i] = min_d_i;
 	}
+	return min_d_i;
 }
 
-/* 3 - Function to calculate the compactness of each group (average distance between all the elements in the group) 
-   Input:  elems     elements (matrix of size nelems x NFEAT, by reference)
-           iingrs   indices of the elements in each group (vector of size NGROUPS with information for each group)
-   Output: compact  compactness of each group (vector of size NGROUPS, by reference) 
+/* 3 - Function to select randomly the first centroids (the second half of the features is a copy of the first one)
+   Input:   seed    seed of the random generator (147 in the original program)
+   Output:  cent    centroids, NGROUPS x NFEAT
 ***************************************************************************************************/
-void groupcompactness(float **elems, struct ginfo *iingrs, float *compact)
+void initcentroids(float cent[][NFEAT], unsigned int seed)
 {
-	// We need this variable because compact variable points to an average of distances, and
-	// if we try to calculate the sum of all distances in this variable, if the group is so big,
-	// it may not fit and the compiler will try to round it, so the final result is not going to be
-	// completely accurate
-	double comp_aux;
-	int gsize;
-
-	// Iterate over each group
-	#pragma omp for nowait private(gsize, comp_aux) schedule(dynamic)
+	srand(seed);
 	for (int i = 0; i < NGROUPS; i++)
-	{
-		gsize = iingrs[i].size;
-		if (gsize <= 1)
-			compact[i] = 0.0;
-		else
+		for (int j = 0; j < NFEAT / 2; j++)
 		{
-			comp_aux = 0.0;
-			// Iterate over each element of the group
-			for (int j = 0; j < gsize; j++)
-				// Get the distance of the element j with respect the rest of the elements of the group
-				for (int k = j + 1; k < gsize; k++)
-				comp_aux += geneticdistance(elems[iingrs[i].members[j]], elems[iingrs[i].members[k]]);
-			compact[i] = (float)(comp_aux / ((gsize * (gsize - 1)) / 2));
+			cent[i][j] = (rand() % 10000) / 100.0;
+			cent[i][j + NFEAT / 2] = cent[i][j];
 		}
-	}
 }
 
-/* 4 - Function to analyse diseases 
-   Input:  iingrs   indices of the elements in each group (matrix of size NGROUPS x nelems, by reference)
-           dise     information about the diseases (NGROUPS x TDISEASE)
-   Output: disepro  analysis of the diseases: maximum, minimum of the medians and groups
+/* 4 - Function to calculate the new centroids and decide to finish or not depending on DELTA
+   Input:   additions  values of each feature accumulated per group, last value: number of elements
+            changed    groups whose members have changed (NULL: all); the others are frozen and skipped
+   Output:  cent       centroids, updated for the non empty groups
+            finish     set to 0 if any centroid moves more than DELTA
 ***************************************************************************************************/
-void diseases(int nelems, struct ginfo *iingrs, float **dise, struct analysis *disepro)
+void newcentroids(double additions[][NFEAT + 1], float cent[][NFEAT], int *changed, int *finish)
 {
-	float *diseaseList;
-	float median;
-	int gsize;
-
-	// Intialize disepro struct for the current disease
-	// [*] static schedule, similar workload for each iteration
-	#pragma omp for
-	for (int i = 0; i < TDISEASE; i++)
-	{
-		disepro[i].mmax = FLT_MIN;
-		disepro[i].mmin = FLT_MAX;
-	}
-
-	#pragma omp for nowait private(gsize, diseaseList, median) schedule(dynamic)
+	// [*] Static schedule. Could be dynamic because of the inner condition,
+	// but there are almost never empty groups (in our case never)
+	#pragma omp for nowait
 	for (int i = 0; i < NGROUPS; i++)
-	{
-		gsize = iingrs[i].size;
+		if ((additions[i][NFEAT] > 0) && ((changed == NULL) || changed[i])) // not empty and not frozen
+			if (movecentroid(additions[i], cent[i]) > DELTA)
+				*finish = 0; // there is change at least in one of the dimensions; continue with the process
+}
+
+/* 4b - Function to move one centroid to the average of its group (the group must not be empty)
+   Input:   add     values of each feature accumulated for the group, last value: number of elements
+   Output:  cent    centroid of the group, updated
+            returns the distance between the old and the new centroid
+***************************************************************************************************/
+double movecentroid(double *add, float *cent)
+{
+	float newcent[NFEAT];
+	double discent;
 
-		diseaseList = (float *)malloc(gsize * sizeof(float));
+	for (int j = 0; j < NFEAT; j++)
+		newcent[j] = add[j] / add[NFEAT];
 
-		if (gsize > 0)
+	// to decide if the process needs to be finished
+	discent = geneticdistance(newcent, cent);
+
+	// copy new centroids
+	for (int j = 0; j < NFEAT; j++)
+		cent[j] = newcent[j];
+
+	return discent;
+}
+
+/* 5 - Function to get the median of a list of values (the list is reordered in place)
+   Input:  list     values of one disease for the members of a group (vector of size gsize, by reference)
+           gsize    number of values
+   Output: median of the values: the value in position gsize / 2 of the sorted list, as the
+           original version took it after a merge sort
+   [*] quickselect: only the side of the median is partitioned, O(gsize) instead of O(gsize log gsize)
+***************************************************************************************************/
+float groupmedian(float *list, int gsize)
+{
+	int l = 0, r = gsize - 1, k = gsize / 2, i, j;
+	float pivot, aux;
+
+	while (l < r)
+	{
+		pivot = list[l + (r - l) / 2];
+		i = l;
+		j = r;
+		while (i <= j)
 		{
-			for (int j = 0; j < TDISEASE; j++)
+			while (list[i] < pivot) i++;
+			while (list[j] > pivot) j--;
+			if (i <= j)
 			{
-				// Fill the auxiliary array with all the value for current disease of current group
-				for (int k = 0; k < gsize; k++)
-					diseaseList[k] = dise[iingrs[i].members[k]][j];
-
-				mergeSort(diseaseList, 0, gsize - 1);
-
-				// Get the median
-				if (gsize % 2 == 0) median = diseaseList[(gsize + 1) / 2];
-				else median = diseaseList[(gsize) / 2];
-
-				#pragma omp critical
-				{
-					// Check if it is the new maximum / minimum of the current disease´
-					if ((median < disepro[j].mmin) || ((median == disepro[j].mmin) && (i < disepro[j].gmin)))
-					{
-						disepro[j].mmin = median;
-						disepro[j].gmin = i;
-					}
-					if ((median > disepro[j].mmax) || ((median == disepro[j].mmax) && (i < disepro[j].gmax)))
-					{
-						disepro[j].mmax = median;
-						disepro[j].gmax = i;
-					}
-				}
+				aux = list[i];
+				list[i] = list[j];
+				list[j] = aux;
+				i++;
+				j--;
 			}
 		}
-		// Free the memory
-		free(diseaseList);
+		// [l..j] <= pivot <= [i..r], and values between j and i are equal to the pivot
+		if (k <= j) r = j;
+		else if (k >= i) l = i;
+		else break;
 	}
+	return list[k];
 }
 
-// Merges two subarrays of arr[].
-// First subarray is arr[l..m]
-// Second subarray is arr[m+1..r]
-void merge(float arr[], int l, int m, int r)
+/* 6 - Function to check if the median of a group is the new maximum / minimum of a disease
+   Input:  dis      disease
+           group    group of the median
+           median   median of the disease in the group
+   Output: disepro  analysis of the diseases, updated
+***************************************************************************************************/
+void updatedisepro(struct analysis *disepro, int dis, int group, float median)
 {
-   int i, j, k;
-   int n1 = m - l + 1;
-   int n2 = r - m;
-
-   /* create temp arrays */
-   float L[n1], R[n2];
-
-   /* Copy data to temp arrays L[] and R[] */
-   for (i = 0; i < n1; i++)
-      L[i] = arr[l + i];
-   for (j = 0; j < n2; j++)
-      R[j] = arr[m + 1 + j];
-
-   /* Merge the temp arrays back into arr[l..r]*/
-   i = 0; // Initial index of first subarray
-   j = 0; // Initial index of second subarray
-   k = l; // Initial index of merged subarray
-   while (i < n1 && j < n2)
-   {
-      if (L[i] <= R[j])
-      {
-         arr[k] = L[i];
-         i++;
-      }
-      else
-      {
-         arr[k] = R[j];
-         j++;
-      }
-      k++;
-   }
-
-   /* Copy the remaining elements of L[], if there
-    are any */
-   while (i < n1)
-   {
-      arr[k] = L[i];
-      i++;
-      k++;
-   }
-
-   /* Copy the remaining elements of R[], if there
-    are any */
-   while (j < n2)
-   {
-      arr[k] = R[j];
-      j++;
-      k++;
-   }
+	#pragma omp critical
+	{
+		// Check if it is the new maximum / minimum of the current disease´
+		if ((median < disepro[dis].mmin) || ((median == disepro[dis].mmin) && (group < disepro[dis].gmin)))
+		{
+			disepro[dis].mmin = median;
+			disepro[dis].gmin = group;
+		}
+		if ((median > disepro[dis].mmax) || ((median == disepro[dis].mmax) && (group < disepro[dis].gmax)))
+		{
+			disepro[dis].mmax = median;
+			disepro[dis].gmax = group;
+		}
+	}
 }
-
-/* l is for left index and r is right index of the
-sub-array of arr to be sorted */
-void mergeSort(float arr[], int l, int r)
-{
-   if (l < r)
-   {
-      // Same as (l+r)/2, but avoids overflow for
-      // large l and h
-      int m = l + (r - l) / 2;
-
-      // Sort first and second halves
-      mergeSort(arr, l, m);
-      mergeSort(arr, m + 1, r);
-
-      merge(arr, l, m, r);
-   }
-}
\ No newline at end of file
@@ -0,0 +1,303 @@
+/*
+   fungg_p.h
+   headers of the functions and structs used only in the parallel version (gengroups_p.c)
+***************************************************************/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define STREAMCHUNK 16384	//streaming mode: default number of rows per chunk
+#define TILEPAIRS   262144	//Phase 2 tasks: distances of each compactness tile
+#define GROUPSLOTS  2	//Phase 2 tasks: groups copied at a time per thread
+#define QLEVELS     256	//quantized diseases: codes of one byte
+#define ZBLOCKS     256	//compressed input: BGZF blocks inflated in parallel at a time
+#define TUNEFILE    "gengroups_p.tune"	//autotuning: best configuration of each host and data shape
+#define TUNESAMPLE  10000	//autotuning: elements of the calibration
+#define TUNEIT      5	//autotuning: iterations of Phase 1 of each trial
+#define BISECTCHUNK 4096	//bisecting mode: elements of each task of a 2-means
+#define DETBLOCK    4096	//deterministic mode: elements of each block of the fixed-order sums
+#define KDLEAF      32	//kd-tree engine: maximum elements of a leaf
+#define KDTASK      16384	//kd-tree engine: minimum elements of a subtree to be a task
+#define ELEMFILE    "elements_p.bin"	//per element output: group, distance to the centroid and silhouette
+#define INCIT       5	//incremental mode: maximum number of Lloyd iterations after the new elements
+
+// group of an element: the narrowest type for NGROUPS groups and the GNONE mark (no group yet)
+#if NGROUPS < 255
+typedef unsigned char gindex;
+#else
+typedef unsigned short gindex;
+#endif
+#define GNONE ((gindex)-1)
+
+struct arena               // memory of the run, reserved at once (see arenagg_p.c)
+{
+ char   *base;
+ size_t  size;             // reserved bytes
+ size_t  used;             // bytes in use (bump pointer)
+ size_t  peak;             // maximum of used since the last arenapeak
+ int     huge;             // 2: explicit huge pages, 1: transparent huge pages, 0: normal pages
+ int     sub;              // 1 if it is a sub-arena (scratch) inside another arena
+};
+
+struct gcsr                // members of all the groups in one vector (replaces struct ginfo in this version)
+{
+ int  size[NGROUPS];       // number of elements of each group
+ int  first[NGROUPS + 1];  // members of group g: members[first[g]] .. members[first[g + 1] - 1]
+ int *members;
+};
+
+struct qdise               // diseases quantized to one byte per value (option -q)
+{
+ unsigned char *code;      // code of each value, nelems x TDISEASE
+ float  book[TDISEASE][QLEVELS]; // value of each code of each disease
+ char   used[TDISEASE][QLEVELS]; // code found in the file
+ int    exact;             // 1 if every value is the value of its code (the medians are exact)
+};
+
+struct stream              // out-of-core access to a binary matrix (float32 rows)
+{
+ int     fd;               // file descriptor of the binary file
+ int     nrows, ncols;     // rows in the file and floats per row
+ int     chunk;            // rows per chunk
+ float  *buf[2];           // double buffer: one chunk is read while the other one is processed
+ float **rows[2];          // row pointers into buf, to reuse the float ** routines
+};
+
+struct pipeline            // background loader of the diseases and writer of the results
+{
+ pthread_t        loader, writer;
+ pthread_mutex_t  lock;
+ pthread_cond_t   ready;
+ int              stage;   // sections that can be written: 1 centroids and sizes, 2 compactness, 3 diseases
+ FILE            *f;       // results file
+ float          (*cent)[NFEAT];
+ struct gcsr     *iingrs;
+ float           *compact;
+ struct analysis *disepro;
+ char            *fname;   // loader: file, number of elements and matrix of diseases
+ int              nelems;
+ float          **dise;
+ struct qdise    *qd;      // quantized diseases (NULL: dise is read)
+};
+
+struct restart             // statistics of each restart of the ensemble mode
+{
+ unsigned int seed;        // seed of the first centroids
+ int          niter;       // iterations until convergence
+ double       inertia;     // sum of the squared distances of the elements to their centroid
+};
+
+struct sweepk              // results of each K of the sweep mode
+{
+ int    k, niter;
+ double inertia;           // sum of the squared distances of the elements to their centroid
+ float  compact;           // average compactness of the non empty groups
+};
+
+struct tuning              // configuration of each phase (see tunegg_p.c)
+{
+ int  clusthr;             // Phase 1: threads, schedule kind (omp_sched_t) and chunk of the classification
+ int  clussched, cluschunk;
+ int  orgthr;              // members of the groups: threads
+ int  compthr;             // compactness and medians: threads and distances of each tile
+ int  tilepairs;
+};
+
+struct incstate            // state of the previous run, for the incremental mode (see incgg_p.c)
+{
+ int           nprev;      // elements of the previous run (0: no state, full run)
+ unsigned long elemcrc, disecrc; // checksums of its elements and diseases
+ float         cent[NGROUPS][NFEAT];
+ double        add[NGROUPS][NFEAT + 1]; // additions of each group, last value: number of elements
+ double        pairsum[NGROUPS];        // sum of the distances of all the pairs of each group
+ float         medians[NGROUPS][TDISEASE];
+ gindex       *grind;      // group of each element of the previous run
+};
+
+struct kdnode              // node of the kd-tree (see kdgg_p.c): elements idx[first .. first + n)
+{
+ float  lo[NFEAT], hi[NFEAT]; // bounding box
+ double sum[NFEAT];        // sum of the elements
+ double sumsq;             // sum of their squared norms (inertia of the telemetry)
+ int    first, n;
+ int    left, right;       // children (-1: leaf)
+};
+
+struct kdtree
+{
+ struct kdnode *nodes;     // root: nodes[0]
+ int           *idx;       // elements, in the order of the leaves
+ int            nnodes, maxnodes;
+};
+
+struct coreset             // weighted sample of the elements (see coregg_p.c)
+{
+ int     n;
+ float **elems;            // rows of the chosen elements
+ float  *weight;           // number of elements each one stands for
+ gindex *grind;            // group of each one
+};
+
+struct projection          // projection of the elements on their first principal components (see projgg_p.c)
+{
+ int    r;                 // dimensions
+ double mean[NFEAT];
+ double p[NFEAT][NFEAT];   // components: first r rows, orthonormal
+ double kept;              // share of the variance of the r components
+ double *y;                // projected elements, nelems x r
+};
+
+struct telemetry           // per iteration lines of Phase 1 (see telegg_p.c)
+{
+ FILE   *f;
+ int     every;            // sampling: one line every N iterations
+ int     json;             // 1: JSON lines, 0: CSV
+ double  t0;               // start of Phase 1
+};
+
+struct partial             // changes found by one thread in one iteration of Phase 1 (see lloydgg_p.c)
+{
+ double add[NGROUPS][NFEAT + 1];
+ int    changed[NGROUPS];
+ int    nchanges;
+ double inertia;           // squared distances of the elements to their group, by their weight (telemetry)
+};
+
+// arena: bytes of the scratch sub-arena of each thread: what lloyd takes (the partial of the thread and,
+// in thread 0, the shared additions and projected centroids) and a margin for the alignment
+#define ARENASCRATCH (sizeof(struct partial) + NGROUPS * (NFEAT + 1) * sizeof(double) \
+					  + NGROUPS * NFEAT * sizeof(double) + (1 << 16))
+
+struct groupwork           // data of the tasks of one group in Phase 2 (see taskgg_p.c)
+{
+ float  *rows;             // members' elements, size x NFEAT
+ float  *dis;              // members' diseases, by disease: TDISEASE x size
+ unsigned char *qdis;      // or members' codes of the diseases, by disease
+ int     ntiles;
+ int    *tfirst;           // first row of each tile (ntiles + 1 values)
+ double *tsum;             // sum of the distances of each tile
+};
+
+struct groupsize           // group and its size, to sort the groups of Phase 2 by size
+{
+ int size;
+ int g;
+};
+
+// arena: bytes of the vectors of analysistasks (work and slot of each group, and order of the groups)
+#define ARENATASKS (NGROUPS * (2 * sizeof(struct groupwork) + sizeof(struct groupsize)))
+
+struct lloydstats          // statistics of Phase 1 (in-memory version)
+{
+ int niter;
+ int totalchanges;         // reassignments of elements in all the iterations
+ int lastchanges;          // reassignments in the last iteration
+ int nfrozen;              // groups without changes, added for all the iterations
+ long nexact;              // distances in NFEAT dimensions (projection, see projgg_p.c)
+};
+
+// fungg_p.c
+extern int nearestcentroid(float *elem, float cent[][NFEAT], int k, double *min_d);
+extern void initcentroids(float cent[][NFEAT], unsigned int seed);
+extern void newcentroids(double additions[][NFEAT + 1], float cent[][NFEAT], int *changed, int *finish);
+extern double movecentroid(double *add, float *cent);
+extern float groupmedian(float *list, int gsize);
+extern void updatedisepro(struct analysis *disepro, int dis, int group, float median);
+
+// streamgg_p.c
+extern int streamconvert(char *fname, int nelems, int ncols, int header, char *binname);
+extern void streamopen(struct stream *st, char *binname, int ncols, int nrows, int chunk);
+extern void streamclose(struct stream *st);
+extern void streamclosestgroup(struct stream *st, float cent[][NFEAT], gindex *grind, double additions[][NFEAT + 1]);
+extern void streambucket(struct stream *ste, struct stream *std, gindex *grind, struct gcsr *iingrs, char *dir);
+extern void streamcompactness(struct gcsr *iingrs, char *dir, float *compact);
+extern void streamdiseases(struct gcsr *iingrs, char *dir, struct analysis *disepro);
+
+// pipegg_p.c
+extern void pipeloaddise(struct pipeline *pl, char *fname, int nelems, float **dise, struct qdise *qd);
+extern void pipewaitdise(struct pipeline *pl);
+extern void pipestartwriter(struct pipeline *pl, FILE *f, float cent[][NFEAT], struct gcsr *iingrs, float *compact, struct analysis *disepro);
+extern void pipestage(struct pipeline *pl, int stage);
+extern void pipeendwriter(struct pipeline *pl);
+extern void writecentroids(FILE *f2, float cent[][NFEAT]);
+extern void writesizes(FILE *f2, struct gcsr *iingrs);
+extern void writecompactness(FILE *f2, float *compact);
+extern void writediseases(FILE *f2, struct analysis *disepro);
+
+// ensemblegg_p.c
+extern int ensemble(int nelems, float **elems, int nrest, float cent[][NFEAT], gindex *grind, struct restart *rstats);
+extern void writerestarts(FILE *f2, struct restart *rstats, int nrest, int best);
+
+// sweepgg_p.c
+extern int sweep(int nelems, float **elems, int kmin, int kmax, int kstep, struct sweepk *res, struct gcsr *iingrs, struct arena *ar);
+extern void writesweep(FILE *f2, struct sweepk *res, int nk);
+
+// lloydgg_p.c
+extern void lloyd(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct lloydstats *ls, struct arena *scratch, int maxit, double warm[][NFEAT + 1], float *weight, struct projection *pj);
+extern void lloyddet(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct lloydstats *ls, struct arena *ar, int maxit, int keep);
+
+// bisectgg_p.c
+extern void bisect(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct arena *ar, int *nsplits, int *niter);
+
+// taskgg_p.c
+extern int tilepairs;
+extern void groupmembers(int nelems, gindex *grind, struct gcsr *iingrs, struct arena *ar);
+extern int pairtiles(int gsize, int *tfirst);
+extern void analysistasks(float **elems, float **dise, struct qdise *qd, struct gcsr *iingrs, float *compact, double *pairsum, float medians[][TDISEASE], struct arena *ar);
+extern void analysemedians(float medians[][TDISEASE], struct gcsr *iingrs, struct analysis *disepro);
+
+// arenagg_p.c
+extern void arenainit(struct arena *ar, size_t size);
+extern void arenadestroy(struct arena *ar);
+extern void *arenaalloc(struct arena *ar, size_t bytes);
+extern size_t arenamark(struct arena *ar);
+extern void arenarelease(struct arena *ar, size_t mark);
+extern void arenasub(struct arena *ar, struct arena *sub, size_t size);
+extern size_t arenapeak(struct arena *ar);
+
+// zipgg_p.c
+extern FILE *zopen(char *fname);
+
+// tunegg_p.c
+extern void tunedefault(struct tuning *tu, int nthr);
+extern int tuneload(char *fname, int nelems, int nthr, struct tuning *tu);
+extern void tunesave(char *fname, int nelems, int nthr, struct tuning *tu);
+extern void tune(int nelems, float **elems, int nthr, struct gcsr *iingrs, struct arena *ar, struct arena *scratch, struct tuning *tu);
+extern void tuneprint(struct tuning *tu);
+
+// kdgg_p.c
+extern void kdtreebuild(int nelems, float **elems, struct kdtree *kt, struct arena *ar);
+extern long kdlloyd(int nelems, float **elems, struct kdtree *kt, float cent[][NFEAT], gindex *grind, struct lloydstats *ls, struct arena *ar, int maxit);
+
+// coregg_p.c
+extern void coreset(int nelems, float **elems, int m, struct coreset *cs, struct arena *ar);
+extern void coresetfree(struct coreset *cs);
+extern double assignall(int nelems, float **elems, float cent[][NFEAT], gindex *grind);
+extern double coresetinertia(struct coreset *cs, float cent[][NFEAT]);
+
+// projgg_p.c
+extern void projbuild(int nelems, float **elems, int r, struct projection *pj, struct arena *ar);
+extern void projcent(struct projection *pj, float cent[][NFEAT], double *pcent, int g0, int g1);
+extern int projnearest(struct projection *pj, int i, float *elem, float cent[][NFEAT], double *pcent, double *min_d, long *nexact);
+
+// telegg_p.c
+extern struct telemetry *telemetry;
+extern int teleopen(struct telemetry *tl, char *arg);
+extern void teleline(struct telemetry *tl, int niter, int nchanges, double maxshift, double inertia, int last);
+extern void teleclose(struct telemetry *tl);
+
+// silgg_p.c
+extern double silhouette(int nelems, float **elems, struct gcsr *iingrs, int nsample, float *sil, struct arena *ar, struct arena *scratch);
+extern void centroiddist(int nelems, float **elems, float cent[][NFEAT], gindex *grind, float *dist);
+extern void writeelements(char *fname, int nelems, gindex *grind, float *dist, float *sil);
+
+// incgg_p.c
+extern unsigned long incdisecrc(int n, float **dise, struct qdise *qd);
+extern int incload(char *fname, int nelems, float **elems, struct incstate *inc, struct arena *ar);
+extern void incassign(int nelems, float **elems, struct incstate *inc, float cent[][NFEAT], gindex *grind, double add[][NFEAT + 1]);
+extern int incanalysis(float **elems, float **dise, struct qdise *qd, gindex *grind, struct gcsr *iingrs, struct incstate *inc, float *compact, float medians[][TDISEASE], struct arena *ar);
+extern void incsave(char *fname, int nelems, float **elems, float **dise, struct qdise *qd, struct gcsr *iingrs, float cent[][NFEAT], float medians[][TDISEASE], gindex *grind, struct incstate *inc);
+
+// quantgg_p.c
+extern float **readqdise(char *fname, int nelems, struct qdise *qd);
+extern float qmedian(unsigned char *codes, int gsize, float *book);
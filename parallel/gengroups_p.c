@@ -9,256 +9,661 @@
             dbdise.dat     input file with information about diseases
     Output: results_p.out  centroids, number of group members and compactness, and diseases
 
-    Compile with module fungg_p.c and include option -lm
+    The input files can be compressed: .gz (gzip; BGZF files, as written by bgzip, are decompressed in
+    parallel) or .zst (zstd, through the zstd program). They are parsed while they are decompressed,
+    without an intermediate file (see zipgg_p.c).
+
+    Options:
+            -s             streaming (out-of-core) mode: elements and diseases are not kept in memory,
+                           every iteration is a sequential pass over a binary file (see streamgg_p.c).
+                           Inputs ending in .bin are used directly as float32 rows (no header)
+            -c chunk       streaming mode: rows per chunk (default STREAMCHUNK)
+            -d dir         streaming mode: directory for the binary and bucket files (default .)
+            -p             pipelined mode: dbdise.dat is loaded while Phase 1 runs, and results_p.out is
+                           written section by section while Phase 2 runs: centroids and sizes while the
+                           graph of tasks of compactness and medians runs (see pipegg_p.c).
+                           T_read then only counts dbgen.dat and T_write only the last section
+            -r nrest       ensemble mode: nrest restarts with seeds 147, 148, ... interleaved in the same
+                           passes over the elements; the one with the lowest inertia is written, with
+                           the statistics of every restart (see ensemblegg_p.c)
+            -k kmin:kmax[:kstep]
+                           sweep mode: cluster for every K in the range (kmax <= NGROUPS), each K warm
+                           started from the previous one, and write iterations, inertia and average
+                           compactness of each K in sweep_p.out; Phase 2 is not run (see sweepgg_p.c)
+            -b nref        bisecting mode: Phase 1 splits the elements with 2-means recursively until there are
+                           NGROUPS groups, then runs at most nref flat iterations (0: none). Phase 2 and
+                           the results file are as usual (see bisectgg_p.c)
+            -i statefile   incremental mode: the groups of the previous run (kept in statefile) are the
+                           start when new elements are appended to the input files. The new elements go to
+                           the nearest centroid, then at most INCIT iterations refine all of them, and
+                           Phase 2 only updates the groups with changes. Without a valid statefile the run
+                           is a full one; every run writes the statefile for the next one (see incgg_p.c)
+            -a engine      assignment engine of Phase 1: brute (default, every distance) or kd (kd-tree
+                           of the elements built once, with filtering of the candidate centroids in every
+                           node; it prints the distances calculated compared to brute, see kdgg_p.c)
+            -m size[:full] coreset mode: Phase 1 runs on a weighted sample of about size elements, chosen
+                           with sensitivity sampling, then every element goes to the nearest final centroid
+                           and Phase 2 is as usual. The inertia of all the elements is printed with the
+                           estimate of the coreset; with :full a normal run is done too (not timed) to print
+                           the inertia gap (see coregg_p.c)
+            -j dims        projection: the elements are projected on their first dims principal components
+                           before Phase 1, and the distances in dims dimensions (lower bounds) leave only a
+                           few exact distances per element; the groups are the same (see projgg_p.c)
+            -l file[:every]
+                           telemetry: one line per iteration of Phase 1 (or one of every N) with the wall
+                           time, reassignments, maximum shift of a centroid and inertia, flushed at once
+                           to file (a named pipe, or - for stderr), as CSV or as JSON lines if the file ends
+                           in .json or .jsonl (see telegg_p.c)
+            -o nsample     per element output: silhouette of every element (nsample 0) or of nsample elements
+                           (exact for each one, the mean is estimated), with a blocked parallel kernel of
+                           distances, and distance of every element to its centroid; written with the groups
+                           to elements_p.bin, not timed in T_write (see silgg_p.c)
+            -e             deterministic mode: Phase 1 adds fixed blocks of elements in a fixed order, and
+                           the compactness tiles have the fixed size TILEPAIRS, so the results are the same
+                           bits with any number of threads (see lloydgg_p.c)
+            -t             autotuning: a short calibration finds the best schedule, tile size and number of
+                           threads of each phase, and saves them in gengroups_p.tune for this host and
+                           data shape; later runs with the same key use them without -t (see tunegg_p.c)
+            -q             quantized diseases: one byte per value instead of float32, with exact medians
+                           (checked while reading; if they can not be exact, float32 is used, see quantgg_p.c)
+
+    Memory: elements, diseases, groups and the buffers of the phases come from one arena reserved at
+    the start with huge pages when possible (see arenagg_p.c); its peak use and the minor page faults
+    of each phase are printed with the times, and the footprint of the main structures compared to
+    the original layout (int groups, struct ginfo members, float32 diseases). The group of each
+    element is kept in the narrowest type for NGROUPS (gindex, see fungg_p.h).
+
+    Compile with modules fungg_p.c, streamgg_p.c, pipegg_p.c, ensemblegg_p.c, sweepgg_p.c, lloydgg_p.c, taskgg_p.c, arenagg_p.c, quantgg_p.c, zipgg_p.c, tunegg_p.c, bisectgg_p.c, incgg_p.c, kdgg_p.c, coregg_p.c, projgg_p.c, telegg_p.c and silgg_p.c and include options -lm -lz -pthread
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <omp.h>
 
 #include "../shared/definegg.h"
 #include "../shared/fungg.h"
+#include "fungg_p.h"
 
 float **elems;				  // matrix to keep information about every element
-struct ginfo iingrs[NGROUPS]; // vector to store information about each group: members and size
+struct gcsr iingrs;           // information about each group: size and members (of all the groups in one vector)
 
 float **dise;					   // probabilities of diseases (from dbdise.dat)
+struct qdise qd;                   // or their codes (option -q)
 struct analysis disepro[TDISEASE]; // vector to store information about each disease (max, min, group...)
 
+struct incstate inc;               // state of the previous run (option -i)
+
+// vectors of the groups: not on the stack of main, they grow with NGROUPS
+float cent[NGROUPS][NFEAT];        // centroids
+double additions[NGROUPS][NFEAT + 1];
+float compact[NGROUPS];            // compactness of each group or cluster
+float medians[NGROUPS][TDISEASE];  // median of each disease in each group
+
 // Main program
 // ============
 void main(int argc, char *argv[])
 {
-	float cent[NGROUPS][NFEAT], newcent[NGROUPS][NFEAT]; // centroids and new centroids
-	double additions[NGROUPS][NFEAT + 1];
-	float compact[NGROUPS]; // compactness of each group or cluster
-
 	int i, j;
-	int nelems, group;
-	int *grind; // group assigned to each element
+	int nelems;
+	gindex *grind; // group assigned to each element
+	struct lloydstats ls;   // reassignments and frozen groups of Phase 1
 	int finish = 0, niter = 0;
-	double discent;
-
-	FILE *f1, *f2;
-	struct timespec t1, t2, t3, t4, t5, t6, t7;
+	int opt, stream = 0, chunk = STREAMCHUNK, pipelined = 0, nrest = 0, best = 0, quant = 0;
+	int kmin = 0, kmax = 0, kstep = 1, nk;
+	int bisectref = -1, nsplits = 0, bisectit = 0; // bisecting mode: flat iterations after the tree (-1: not used)
+	char *incfile = NULL;           // incremental mode: state file
+	int incupd = -1;                // groups updated by the incremental Phase 2 (-1: full Phase 2)
+	int determ = 0;                 // deterministic mode: same results with any number of threads
+	int kd = 0;                     // assignment engine: 0 brute force, 1 kd-tree
+	struct kdtree kt;
+	long kddist = 0;                // kd-tree engine: distances calculated
+	double t_kd = 0.0;
+	int coresize = 0, corefull = 0; // coreset mode: expected size, and reference run
+	struct coreset cs;
+	double inertia = 0.0, coreinertia = 0.0, refinertia = 0.0, t_ref = 0.0;
+	int refiter = 0;
+	int projdims = 0;               // projection: dimensions (0: not used)
+	struct projection proj, *pj = NULL;
+	double t_proj = 0.0;
+	char *telefile = NULL;          // telemetry: file[:every]
+	struct telemetry tl;
+	int silsample = -1;             // silhouette: elements to evaluate (0: all, -1: not used)
+	float *sil, *cdist;
+	double silmean = 0.0, t_sil = 0.0;
+	char *dir = ".", binelems[4096], bindise[4096];
+	struct stream stelems, stdise;
+	struct stat sb;
+	struct pipeline pl;
+	struct restart *rstats = NULL;
+	struct sweepk *sweepres;
+	struct arena ar, *scratch;      // memory of the run, and scratch sub-arena of each thread
+	size_t arsize, disesize, peak[5]; // peak of the arena in each phase: read, clus, org, compact, anal
+	long faults[6];                 // minor page faults at the start of each phase
+	int nthr = omp_get_max_threads();
+	struct rusage ru;
+	struct tuning tu;               // schedule and threads of each phase
+	int tunemode = 0, tuned = 0;    // tuned: 1 read from TUNEFILE, 2 calibrated in this run
+	double t_tune = 0.0;
+
+	FILE *f1, *f2 = NULL;
+	struct timespec t1, t2, t3, t4, t5, t6, t7, tw; // tw: start of T_write
 	double t_read, t_clus, t_org, t_compact, t_anal, t_write;
 
-	if ((argc < 3) || (argc > 4))
+	while ((opt = getopt(argc, argv, "sc:d:pr:k:qtb:i:ea:m:j:l:o:")) != -1)
+	{
+		switch (opt)
+		{
+		case 's': stream = 1; break;
+		case 'c': chunk = atoi(optarg); break;
+		case 'd': dir = optarg; break;
+		case 'p': pipelined = 1; break;
+		case 'q': quant = 1; break;
+		case 't': tunemode = 1; break;
+		case 'i': incfile = optarg; break;
+		case 'e': determ = 1; break;
+		case 'l': telefile = optarg; break;
+		case 'o': silsample = atoi(optarg); if (silsample < 0) argc = 0; break;
+		case 'j': projdims = atoi(optarg); if ((projdims < 1) || (projdims > NFEAT)) argc = 0; break;
+		case 'm': coresize = atoi(optarg); corefull = (strstr(optarg, ":full") != NULL); if (coresize < 1) argc = 0; break;
+		case 'a': kd = (strcmp(optarg, "kd") == 0); if (!kd && (strcmp(optarg, "brute") != 0)) argc = 0; break;
+		case 'b': bisectref = atoi(optarg); if (bisectref < 0) argc = 0; break;
+		case 'r': nrest = atoi(optarg); break;
+		case 'k': if (sscanf(optarg, "%d:%d:%d", &kmin, &kmax, &kstep) < 2) argc = 0; break;
+		default: argc = 0; // wrong option, show the usage
+		}
+	}
+	// from now on, argv[1] is the first file as in the original version
+	argv += optind - 1;
+	argc -= optind - 1;
+
+	if ((argc < 3) || (argc > 4) || (chunk <= 0) || (nrest < 0) || (stream && (nrest || quant || tunemode)) || ((bisectref >= 0) && (stream || nrest || kmin))
+		|| (incfile && (stream || nrest || kmin || (bisectref >= 0))) || (determ && (stream || nrest || kmin))
+		|| (kd && (stream || nrest || kmin || (bisectref >= 0) || incfile || determ))
+		|| (coresize && (stream || nrest || kmin || (bisectref >= 0) || incfile || determ || kd))
+		|| (projdims && (stream || nrest || kmin || coresize || determ || kd)) || (telefile && (stream || nrest || kmin))
+		|| ((silsample >= 0) && (stream || kmin))
+		|| (kmin && ((kmin < 1) || (kmax > NGROUPS) || (kmin > kmax) || (kstep < 1) || stream || pipelined || nrest)))
 	{
-		printf("ATTENTION: progr file1 (elems) file2 (dise) [num elems])\n");
+		printf("ATTENTION: progr [-s [-c chunk] [-d dir] | -r nrest | -k kmin:kmax[:kstep] | -b nref | -i statefile | -m size[:full]] [-a brute|kd | -j dims] [-e] [-l file[:every]] [-o nsample] [-p] [-q] [-t] file1 (elems) file2 (dise) [num elems])\n");
 		exit(-1);
 	}
+	if (nrest > 0)
+		rstats = (struct restart *)malloc(nrest * sizeof(struct restart));
 
 	printf("\n >> Parallel execution\n");
+	getrusage(RUSAGE_SELF, &ru);
+	faults[0] = ru.ru_minflt;
 	clock_gettime(CLOCK_REALTIME, &t1);
 
-	// read data from files: elems[i][j] and dise[i][j]
-	// ===============================================
-	f1 = fopen(argv[1], "r");
-	if (f1 == NULL)
+	// streaming mode: convert the input to binary files of float32 rows, but keep only grind in memory
+	// ================================================================================================
+	if (stream)
 	{
-		printf("Error opening file %s \n", argv[1]);
-		exit(-1);
-	}
+		if ((strlen(argv[1]) > 4) && (strcmp(argv[1] + strlen(argv[1]) - 4, ".bin") == 0))
+		{
+			// already binary: the number of elements is given by the size of the file
+			if (stat(argv[1], &sb) != 0)
+			{
+				printf("Error opening file %s \n", argv[1]);
+				exit(-1);
+			}
+			nelems = sb.st_size / (NFEAT * sizeof(float));
+			strcpy(binelems, argv[1]);
+			strcpy(bindise, argv[2]);
+			if (argc == 4 && atoi(argv[3]) < nelems)
+				nelems = atoi(argv[3]);
+		}
+		else
+		{
+			f1 = zopen(argv[1]);
+			if (f1 == NULL)
+			{
+				printf("Error opening file %s \n", argv[1]);
+				exit(-1);
+			}
+			fscanf(f1, "%d", &nelems);
+			fclose(f1);
+			if (argc == 4)
+				nelems = atoi(argv[3]);
+
+			snprintf(binelems, sizeof(binelems), "%s/dbgen_p.bin", dir);
+			snprintf(bindise, sizeof(bindise), "%s/dbdise_p.bin", dir);
+			streamconvert(argv[1], nelems, NFEAT, 1, binelems);
+			streamconvert(argv[2], nelems, TDISEASE, 0, bindise);
+		}
 
-	fscanf(f1, "%d", &nelems);
-	if (argc == 4)
-		nelems = atoi(argv[3]);
+		streamopen(&stelems, binelems, NFEAT, nelems, chunk);
+		streamopen(&stdise, bindise, TDISEASE, nelems, chunk);
 
-	// Assign memory dynamically to elems, dise and grind
-	elems = (float **)malloc(nelems * sizeof(float *));
-	dise = (float **)malloc(nelems * sizeof(float *));
-	grind = (int *)malloc(nelems * sizeof(int));
-	for (i = 0; i < nelems; i++)
-	{
-		elems[i] = (float *)malloc(NFEAT * sizeof(float));
-		dise[i] = (float *)malloc(TDISEASE * sizeof(float));
+		// only grind (and the scratch of the threads) in the arena
+		arsize = (size_t)nelems * sizeof(gindex) + nthr * (ARENASCRATCH + sizeof(struct arena)) + (1 << 20);
+		arenainit(&ar, arsize);
+		grind = (gindex *)arenaalloc(&ar, nelems * sizeof(gindex));
+		iingrs.members = NULL;
 	}
+	else
+	{
+		// read data from files: elems[i][j] and dise[i][j]
+		// ===============================================
+		f1 = zopen(argv[1]);
+		if (f1 == NULL)
+		{
+			printf("Error opening file %s \n", argv[1]);
+			exit(-1);
+		}
 
-	for (i = 0; i < nelems; i++)
-		for (j = 0; j < NFEAT; j++)
-			fscanf(f1, "%f", &(elems[i][j]));
+		fscanf(f1, "%d", &nelems);
+		if (argc == 4)
+			nelems = atoi(argv[3]);
+
+		// Assign memory from the arena to elems, dise (or its codes), grind and the members of the groups.
+		// It also has space for the slots of Phase 2 (the largest groups, GROUPSLOTS per thread: at most a
+		// copy of the rows of elems and dise, if one group has almost every element) or of the sweep.
+		// The copy of dise is always float32: with -q readqdise falls back to float32 if the codes are
+		// not exact, and then the slots copy float rows.
+		// The vectors of the groups of Phase 2 (ARENATASKS) and one set of centroids, compactness and
+		// additions (sweep, autotuning or reference run) come from the arena too, and with the kd-tree
+		// the additions and changes of every thread
+		disesize = (size_t)nelems * TDISEASE * (quant ? 1 : sizeof(float));
+		arsize = 2 * (size_t)nelems * NFEAT * sizeof(float) + disesize + (size_t)nelems * TDISEASE * sizeof(float)
+			+ 2 * (size_t)nelems * sizeof(float *)
+			+ (size_t)nelems * (sizeof(gindex) + sizeof(int)) + (kmin ? (size_t)nelems * (2 * sizeof(double) + sizeof(gindex)) : 0)
+			+ ((bisectref >= 0) ? (size_t)nelems * (sizeof(int) + 1) : 0)
+			+ (incfile ? (size_t)nelems * (sizeof(gindex) + sizeof(int)) : 0)
+			+ (projdims ? (size_t)nelems * (projdims * sizeof(double) + sizeof(int)) : 0)
+			+ ((silsample >= 0) ? (size_t)nelems * (2 * sizeof(float) + sizeof(int) + sizeof(gindex)) : 0)
+			+ (coresize ? (size_t)nelems * (sizeof(float) + sizeof(gindex)) : 0)
+			+ (kd ? (size_t)nelems * sizeof(int) + (4 * (size_t)(nelems / KDLEAF) + 3) * sizeof(struct kdnode)
+				+ (nthr + 1) * (size_t)NGROUPS * ((NFEAT + 2) * sizeof(double) + 2 * sizeof(int)) : 0)
+			+ ARENATASKS + NGROUPS * ((NFEAT + 1) * sizeof(float) + (NFEAT + 2) * sizeof(double))
+			+ nthr * (ARENASCRATCH + sizeof(struct arena) + NGROUPS * sizeof(int)) + (1 << 20);
+		arenainit(&ar, arsize);
+
+		elems = (float **)arenaalloc(&ar, nelems * sizeof(float *));
+		grind = (gindex *)arenaalloc(&ar, nelems * sizeof(gindex));
+		iingrs.members = (int *)arenaalloc(&ar, nelems * sizeof(int));
+		// one block for each matrix, the rows are contiguous
+		elems[0] = (float *)arenaalloc(&ar, (size_t)nelems * NFEAT * sizeof(float));
+		for (i = 1; i < nelems; i++)
+			elems[i] = elems[0] + (size_t)i * NFEAT;
+		if (quant)
+		{
+			dise = NULL;
+			qd.code = (unsigned char *)arenaalloc(&ar, disesize);
+		}
+		else
+		{
+			dise = (float **)arenaalloc(&ar, nelems * sizeof(float *));
+			dise[0] = (float *)arenaalloc(&ar, disesize);
+			for (i = 1; i < nelems; i++)
+				dise[i] = dise[0] + (size_t)i * TDISEASE;
+		}
 
-	fclose(f1);
+		for (i = 0; i < nelems; i++)
+			for (j = 0; j < NFEAT; j++)
+				fscanf(f1, "%f", &(elems[i][j]));
 
-	f1 = fopen(argv[2], "r");
-	if (f1 == NULL)
-	{
-		printf("Error opening file %s \n", argv[1]);
-		exit(-1);
+		fclose(f1);
+
+		// [*] pipelined: the diseases are not needed until Phase 2, read them in the background
+		if (pipelined)
+			pipeloaddise(&pl, argv[2], nelems, dise, quant ? &qd : NULL);
+		else if (quant)
+			dise = readqdise(argv[2], nelems, &qd); // NULL if the codes are exact
+		else
+		{
+			f1 = zopen(argv[2]);
+			if (f1 == NULL)
+			{
+				printf("Error opening file %s \n", argv[1]);
+				exit(-1);
+			}
+
+			for (i = 0; i < nelems; i++)
+				for (j = 0; j < TDISEASE; j++)
+					fscanf(f1, "%f", &dise[i][j]);
+
+			fclose(f1);
+		}
 	}
 
-	for (i = 0; i < nelems; i++)
-		for (j = 0; j < TDISEASE; j++)
-			fscanf(f1, "%f", &dise[i][j]);
+	// incremental: state of the previous run, if it was made from the first elements of this input
+	if (incfile != NULL)
+		incload(incfile, nelems, elems, &inc, &ar);
 
-	fclose(f1);
+	scratch = (struct arena *)arenaalloc(&ar, nthr * sizeof(struct arena));
+	for (i = 0; i < nthr; i++)
+		arenasub(&ar, &scratch[i], ARENASCRATCH);
 
 	clock_gettime(CLOCK_REALTIME, &t2);
+	peak[0] = arenapeak(&ar);
+	getrusage(RUSAGE_SELF, &ru);
+	faults[1] = ru.ru_minflt;
 
-	// select randomly the first centroids
-	// ===================================
-	srand(147);
-	for (i = 0; i < NGROUPS; i++)
-		for (j = 0; j < NFEAT / 2; j++)
+	// sweep mode: Phase 1 for every K, and only the table of the sweep is written
+	// ===========================================================================
+	if (kmin > 0)
+	{
+		sweepres = (struct sweepk *)malloc(((kmax - kmin) / kstep + 1) * sizeof(struct sweepk));
+		nk = sweep(nelems, elems, kmin, kmax, kstep, sweepres, &iingrs, &ar);
+
+		clock_gettime(CLOCK_REALTIME, &t3);
+
+		f2 = fopen("sweep_p.out", "w");
+		if (f2 == NULL)
 		{
-			cent[i][j] = (rand() % 10000) / 100.0;
-			cent[i][j + NFEAT / 2] = cent[i][j];
+			printf("Error when opening file sweep_p.out \n");
+			exit(-1);
 		}
+		writesweep(f2, sweepres, nk);
+		fclose(f2);
+
+		t_read = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / (double)1e9;
+		t_clus = (t3.tv_sec - t2.tv_sec) + (t3.tv_nsec - t2.tv_nsec) / (double)1e9;
+		printf("\n    T_read:    %6.3f s", t_read);
+		printf("\n    T_sweep:   %6.3f s\n", t_clus);
+		printf("\n    Memory: %.1f MB reserved (%s pages), peak %.1f MB\n\n", ar.size / 1048576.0,
+			   (ar.huge == 2) ? "huge" : (ar.huge == 1) ? "transparent huge" : "normal", arenapeak(&ar) / 1048576.0);
+		writesweep(stdout, sweepres, nk);
+		printf("\n");
+		arenadestroy(&ar);
+		return;
+	}
+
+	// configuration of each phase: fixed, from the tuning file, or from a calibration now
+	// ===================================================================================
+	tunedefault(&tu, nthr);
+	if (tunemode)
+	{
+		t_tune = omp_get_wtime();
+		tune(nelems, elems, nthr, &iingrs, &ar, scratch, &tu);
+		t_tune = omp_get_wtime() - t_tune;
+		tunesave(TUNEFILE, nelems, nthr, &tu);
+		tuned = 2;
+		clock_gettime(CLOCK_REALTIME, &t2); // the calibration is not part of T_clus
+	}
+	else if (!stream && tuneload(TUNEFILE, nelems, nthr, &tu))
+		tuned = 1;
+
+	// select randomly the first centroids
+	// ===================================
+	initcentroids(cent, 147);
+	omp_set_num_threads(tu.clusthr);
+	omp_set_schedule(tu.clussched, tu.cluschunk);
 
 	// Phase 1: classify elements and calculate new centroids
 	// ======================================================
 	niter = 0;
 	finish = 0;
 
-	while ((finish == 0) && (niter < MAXIT))
+	// telemetry of the iterations of this Phase 1 only (not of the calibration or of other runs)
+	if (telefile != NULL)
 	{
-		#pragma omp parallel default(none) shared(nelems, elems, cent, grind, additions, finish, newcent, niter) private(i, j)
+		if (!teleopen(&tl, telefile))
 		{
-			// Obtain the closest group or cluster for each element
-			// [*] Closest group uses pragma omp for
-			closestgroup(nelems, elems, cent, grind);
-		
-			// calculate new centroids for each group:  average of each dimension or feature
-			// additions: to accumulate the values for each feature and cluster. Last value: number of elements in the group
-			// [*] Parallelized initialisation
-			// [*] Static schedule, workload is similar for every iteration
-			#pragma omp for
-			for (i = 0; i < NGROUPS; i++)
-				for (j = 0; j < NFEAT + 1; j++)
-					additions[i][j] = 0.0;
-		
-			// [*] additions is a summation, so reduction +
-			// [*] default scheduling, workload is similar to every thread
-			#pragma omp for nowait reduction(+:additions)
-			for (i = 0; i < nelems; i++)
-			{
-				for (j = 0; j < NFEAT; j++)
-					additions[grind[i]][j] += elems[i][j];
-				additions[grind[i]][NFEAT]++;
-			}
+			printf("Error when opening file %s \n", telefile);
+			exit(-1);
+		}
+		telemetry = &tl;
+	}
+
+	// projection: principal components of the elements, for the bounds of the distances (see projgg_p.c)
+	if (projdims > 0)
+	{
+		t_proj = omp_get_wtime();
+		projbuild(nelems, elems, projdims, &proj, &ar);
+		pj = &proj;
+		t_proj = omp_get_wtime() - t_proj;
+	}
+
+	if (nrest > 0)
+	{
+		// ensemble: nrest restarts on the same elements, the best one is kept in cent and grind
+		best = ensemble(nelems, elems, nrest, cent, grind, rstats);
+		niter = rstats[best].niter;
+	}
+	else if (stream)
+	{
+		while ((finish == 0) && (niter < MAXIT))
+		{
+			// one sequential pass over the elements file: classification and additions
+			streamclosestgroup(&stelems, cent, grind, additions);
 
-			// Calculate new centroids and decide to finish or not depending on DELTA
-			// [*] finish variable is checked by just one thread, and we need a barrier
-			// for the next loop (implicit in #pragma omp single)
-			#pragma omp single
 			finish = 1;
+			#pragma omp parallel default(none) shared(additions, cent, finish)
+			newcentroids(additions, cent, NULL, &finish);
 
-			// [*] Parallelized calculation of new centroids	
-			// [*] Static schedule. Could be dynamic because of the inner condition,
-			// but there are almost never empty groups (in our case never)
-			#pragma omp for nowait private(discent)
-			for (i = 0; i < NGROUPS; i++)
-				if (additions[i][NFEAT] > 0) // the group is not empty
-				{
-					for (j = 0; j < NFEAT; j++)
-						newcent[i][j] = additions[i][j] / additions[i][NFEAT];
-
-					// decide if the process needs to be finished
-					discent = geneticdistance(&newcent[i][0], &cent[i][0]);
-					if (discent > DELTA)
-						finish = 0; // there is change at least in one of the dimensions; continue with the process
-
-					// copy new centroids
-					for (j = 0; j < NFEAT; j++)
-						cent[i][j] = newcent[i][j];
-				}		
+			niter++;
+		} // while
+	}
+	else if (bisectref >= 0)
+	{
+		// tree of 2-means (see bisectgg_p.c), and some flat iterations from its centroids
+		bisect(nelems, elems, cent, grind, &ar, &nsplits, &bisectit);
+		if (bisectref > 0)
+		{
+			if (determ)
+				lloyddet(nelems, elems, cent, grind, &ls, &ar, bisectref, 1);
+			else
+				lloyd(nelems, elems, cent, grind, &ls, scratch, bisectref, NULL, NULL, pj);
+			niter = ls.niter;
 		}
-		niter++;	
-	} // while
+	}
+	else if (kd)
+	{
+		// kd-tree of the elements (built once), then iterations with filtering of the candidates (see kdgg_p.c)
+		t_kd = omp_get_wtime();
+		kdtreebuild(nelems, elems, &kt, &ar);
+		t_kd = omp_get_wtime() - t_kd;
+		kddist = kdlloyd(nelems, elems, &kt, cent, grind, &ls, &ar, MAXIT);
+		niter = ls.niter;
+	}
+	else if (coresize > 0)
+	{
+		// coreset: weighted Lloyd on a sample, then every element to the nearest centroid (see coregg_p.c)
+		coreset(nelems, elems, coresize, &cs, &ar);
+		lloyd(cs.n, cs.elems, cent, cs.grind, &ls, scratch, MAXIT, NULL, cs.weight, NULL);
+		niter = ls.niter;
+		coreinertia = coresetinertia(&cs, cent);
+		inertia = assignall(nelems, elems, cent, grind);
+	}
+	else if (inc.nprev > 0)
+	{
+		// incremental: old groups and new elements to the nearest centroid, and some iterations from there
+		incassign(nelems, elems, &inc, cent, grind, additions);
+		if (determ)
+			lloyddet(nelems, elems, cent, grind, &ls, &ar, INCIT, 1);
+		else
+			lloyd(nelems, elems, cent, grind, &ls, scratch, INCIT, additions, NULL, pj);
+		niter = ls.niter;
+	}
+	else
+	{
+		// all the iterations in one parallel region, with one barrier per iteration (see lloydgg_p.c),
+		// or with fixed-order sums in the deterministic mode
+		if (determ)
+			lloyddet(nelems, elems, cent, grind, &ls, &ar, MAXIT, 0);
+		else
+			lloyd(nelems, elems, cent, grind, &ls, scratch, MAXIT, NULL, NULL, pj);
+		niter = ls.niter;
+	}
 
 	clock_gettime(CLOCK_REALTIME, &t3);
+	if (telemetry != NULL)
+	{
+		teleclose(telemetry);
+		telemetry = NULL;
+	}
+	peak[1] = arenapeak(&ar);
+	getrusage(RUSAGE_SELF, &ru);
+	faults[2] = ru.ru_minflt;
+
+	// [*] pipelined: the writer thread writes each section of the results as soon as it is final
+	if (pipelined)
+	{
+		f2 = fopen("results_p.out", "w");
+		if (f2 == NULL)
+		{
+			printf("Error when opening file results_s.outs \n");
+			exit(-1);
+		}
+		pipestartwriter(&pl, f2, cent, &iingrs, compact, disepro);
+	}
 
 	// Phase 2: count the number of elements of each group and calculate the "compactness" of the group
 	// and analyse diseases
 	// ================================================================================================
-	#pragma omp parallel default(none) shared(iingrs, nelems, grind, t4, elems, compact, t5, dise, disepro) private(i, group)
+	if (stream)
 	{
-		// [*] static scheduling, similar workload per iteration
-		#pragma omp for
-		for (i = 0; i < NGROUPS; i++) iingrs[i].size = 0;
-	
-		// number of elements and classification
-		// [*] Parallelize the classification is possible
-		// [*] But watch out! iingrs struct.size can not be reduced since
-		// it is a struct member. Critical section must be used in order
-		// to prevent more than one thread to edit iingr[group] at the same time
-		#pragma omp for private(i, group)
-		for (i = 0; i < nelems; i++)
+		// the rows of each group go to their own bucket files, only the sizes are kept in memory
+		streambucket(&stelems, &stdise, grind, &iingrs, dir);
+		streamclose(&stelems);
+		streamclose(&stdise);
+		if (strcmp(binelems, argv[1]) != 0)
 		{
-			group = grind[i];
-			#pragma omp critical
-			{
-				iingrs[group].members[iingrs[group].size] = i;
-				iingrs[group].size++;
-			}
+			unlink(binelems);
+			unlink(bindise);
 		}
-	
-		#pragma omp master
-		{
-			// free the memory
-			free(grind);
 
-			clock_gettime(CLOCK_REALTIME, &t4);
-		}
+		clock_gettime(CLOCK_REALTIME, &t4);
+		peak[2] = arenapeak(&ar);
+		getrusage(RUSAGE_SELF, &ru);
+		faults[3] = ru.ru_minflt;
+		if (pipelined)
+			pipestage(&pl, 1);
 
-		// compactness of each group: average distance between elements
-		groupcompactness(elems, iingrs, compact);
+		streamcompactness(&iingrs, dir, compact);
 
-		#pragma omp master
 		clock_gettime(CLOCK_REALTIME, &t5);
+		peak[3] = arenapeak(&ar);
+		getrusage(RUSAGE_SELF, &ru);
+		faults[4] = ru.ru_minflt;
+		if (pipelined)
+			pipestage(&pl, 2);
 
-		// diseases analysis
-		diseases(nelems, iingrs, dise, disepro);
+		streamdiseases(&iingrs, dir, disepro);
 	}
+	else
+	{
+		// number of elements and classification
+		// [*] parallel counting sort, no critical section (see taskgg_p.c)
+		omp_set_num_threads(tu.orgthr);
+		groupmembers(nelems, grind, &iingrs, &ar);
+
+		clock_gettime(CLOCK_REALTIME, &t4);
+		peak[2] = arenapeak(&ar);
+		getrusage(RUSAGE_SELF, &ru);
+		faults[3] = ru.ru_minflt;
+		if (pipelined)
+		{
+			// centroids and sizes are final: written while the graph of tasks runs
+			pipestage(&pl, 1);
+			// the medians of the task graph need the diseases
+			pipewaitdise(&pl);
+			dise = pl.dise;
+		}
 
-	// Free the memory
-	free(elems);
-	free(dise);
+		// compactness of each group (average distance between elements) and medians of the diseases
+		// [*] one graph of tasks for both, largest groups first; T_compact includes the medians
+		omp_set_num_threads(tu.compthr);
+		tilepairs = determ ? TILEPAIRS : tu.tilepairs; // the tiles are added in order, but their size changes the bits
+		// incremental: only the groups with changes, if the diseases of the old elements are the same
+		if ((inc.nprev > 0) && (incdisecrc(inc.nprev, dise, &qd) == inc.disecrc))
+			incupd = incanalysis(elems, dise, &qd, grind, &iingrs, &inc, compact, medians, &ar);
+		else
+			analysistasks(elems, dise, quant ? &qd : NULL, &iingrs, compact, incfile ? inc.pairsum : NULL, medians, &ar);
 
-	clock_gettime(CLOCK_REALTIME, &t6);
+		clock_gettime(CLOCK_REALTIME, &t5);
+		peak[3] = arenapeak(&ar);
+		getrusage(RUSAGE_SELF, &ru);
+		faults[4] = ru.ru_minflt;
+		if (pipelined)
+			pipestage(&pl, 2);
+
+		// diseases analysis: maximum and minimum of the medians
+		analysemedians(medians, &iingrs, disepro);
+	}
 
-	// write results in a file
-	// =======================
+	clock_gettime(CLOCK_REALTIME, &t6);
+	tw = t6;
+	peak[4] = arenapeak(&ar);
+	getrusage(RUSAGE_SELF, &ru);
+	faults[5] = ru.ru_minflt;
 
-	f2 = fopen("results_p.out", "w");
-	if (f2 == NULL)
+	// per element output: distance to the centroid and silhouette (see silgg_p.c)
+	if (silsample >= 0)
 	{
-		printf("Error when opening file results_s.outs \n");
-		exit(-1);
+		t_sil = omp_get_wtime();
+		cdist = (float *)arenaalloc(&ar, nelems * sizeof(float));
+		sil = (float *)arenaalloc(&ar, nelems * sizeof(float));
+		centroiddist(nelems, elems, cent, grind, cdist);
+		silmean = silhouette(nelems, elems, &iingrs, silsample, sil, &ar, scratch);
+		writeelements(ELEMFILE, nelems, grind, cdist, sil);
+		t_sil = omp_get_wtime() - t_sil;
+		clock_gettime(CLOCK_REALTIME, &tw); // not part of T_write
 	}
 
-	fprintf(f2, " Centroids of groups \n\n");
-	for (i = 0; i < NGROUPS; i++)
+	// coreset: normal run from the same first centroids, to compare the inertia
+	if (corefull)
 	{
-		for (j = 0; j < NFEAT; j++)
-			fprintf(f2, "%7.3f", cent[i][j]);
-		fprintf(f2, "\n");
+		size_t mark = arenamark(&ar);
+		gindex *refgrind = (gindex *)arenaalloc(&ar, nelems * sizeof(gindex));
+		float (*refcent)[NFEAT] = arenaalloc(&ar, NGROUPS * sizeof(*refcent));
+		struct lloydstats refls;
+
+		t_ref = omp_get_wtime();
+		initcentroids(refcent, 147);
+		lloyd(nelems, elems, refcent, refgrind, &refls, scratch, MAXIT, NULL, NULL, NULL);
+		refinertia = assignall(nelems, elems, refcent, refgrind);
+		refiter = refls.niter;
+		t_ref = omp_get_wtime() - t_ref;
+		arenarelease(&ar, mark);
+		clock_gettime(CLOCK_REALTIME, &tw); // the reference run is not part of T_write
 	}
 
-	fprintf(f2, "\n >> Size of the groups \n\n");
-	for (i = 0; i < NGROUPS / 10; i++)
+	// incremental: state of this run for the next one (before the elements are freed)
+	if (incfile != NULL)
+		incsave(incfile, nelems, elems, dise, &qd, &iingrs, cent, medians, grind, &inc);
+
+	// Free the memory (everything was in the arena, but the float32 diseases if the codes were not exact)
+	arenadestroy(&ar);
+	if (quant && (dise != NULL))
 	{
-		for (j = 0; j < 10; j++)
-			fprintf(f2, "%6d", iingrs[10 * i + j].size);
-		fprintf(f2, "\n");
+		free(dise[0]);
+		free(dise);
 	}
 
-	fprintf(f2, "\n >> Group compactness \n\n");
-	for (i = 0; i < NGROUPS / 10; i++)
+	// write results in a file
+	// =======================
+
+	if (pipelined)
 	{
-		for (j = 0; j < 10; j++)
-			fprintf(f2, "%9.2f", compact[10 * i + j]);
-		fprintf(f2, "\n");
+		// the writer thread has the first sections done, only the diseases are left
+		pipestage(&pl, 3);
+		pipeendwriter(&pl);
 	}
+	else
+	{
+		f2 = fopen("results_p.out", "w");
+		if (f2 == NULL)
+		{
+			printf("Error when opening file results_s.outs \n");
+			exit(-1);
+		}
 
-	fprintf(f2, "\n\n Analysis of deseases (medians)\n\n");
-	fprintf(f2, "\n Dise.  M_max - Group   M_min - Group");
-	fprintf(f2, "\n ==================================\n");
-	for (i = 0; i < TDISEASE; i++)
-		fprintf(f2, "  %2d     %4.2f - %2d      %4.2f - %2d\n", i, disepro[i].mmax,
-				disepro[i].gmax, disepro[i].mmin, disepro[i].gmin);
+		writecentroids(f2, cent);
+		writesizes(f2, &iingrs);
+		writecompactness(f2, compact);
+		writediseases(f2, disepro);
+	}
+
+	if (nrest > 0)
+		writerestarts(f2, rstats, nrest, best);
 
 	fclose(f2);
 
@@ -272,9 +677,39 @@ void main(int argc, char *argv[])
 	t_org = (t4.tv_sec - t3.tv_sec) + (t4.tv_nsec - t3.tv_nsec) / (double)1e9;
 	t_compact = (t5.tv_sec - t4.tv_sec) + (t5.tv_nsec - t4.tv_nsec) / (double)1e9;
 	t_anal = (t6.tv_sec - t5.tv_sec) + (t6.tv_nsec - t5.tv_nsec) / (double)1e9;
-	t_write = (t7.tv_sec - t6.tv_sec) + (t7.tv_nsec - t6.tv_nsec) / (double)1e9;
+	t_write = (t7.tv_sec - tw.tv_sec) + (t7.tv_nsec - tw.tv_nsec) / (double)1e9;
 
 	printf("\n    Number of iterations: %d", niter);
+	if (bisectref >= 0)
+		printf("\n    Bisecting: %d splits, %d iterations of 2-means", nsplits, bisectit);
+	if (silsample >= 0)
+		printf("\n    Silhouette: mean %.4f of %d elements, %.3f s; written to %s", silmean,
+			   ((silsample == 0) || (silsample > nelems)) ? nelems : silsample, t_sil, ELEMFILE);
+	if (coresize > 0)
+	{
+		printf("\n    Coreset: %d of %d elements (size %d); inertia %.6e, estimate of the coreset %.6e (%+.2f%%)",
+			   cs.n, nelems, coresize, inertia, coreinertia, 100.0 * (coreinertia - inertia) / inertia);
+		if (corefull)
+			printf("\n    Full run: inertia %.6e, %d iterations, %.3f s; gap of the coreset %+.2f%%", refinertia, refiter,
+				   t_ref, 100.0 * (inertia - refinertia) / refinertia);
+		coresetfree(&cs);
+	}
+	if ((pj != NULL) && (niter > 0))
+		printf("\n    Projection: %d of %d dimensions (%.2f%% of the variance) in %.3f s; %.1f%% of the exact distances",
+			   projdims, NFEAT, 100.0 * proj.kept, t_proj, 100.0 * ls.nexact / ((double)nelems * NGROUPS * ls.niter));
+	if (kd)
+		printf("\n    KD-tree: %d nodes built in %.3f s; %ld distances, %.1f%% of brute force", kt.nnodes, t_kd,
+			   kddist, 100.0 * kddist / ((double)nelems * NGROUPS * niter));
+	if (inc.nprev > 0)
+		printf("\n    Incremental: %d previous elements, %d new; %s", inc.nprev, nelems - inc.nprev,
+			   (incupd >= 0) ? "" : "diseases changed, full Phase 2");
+	if (incupd >= 0)
+		printf("%d of %d groups updated", incupd, NGROUPS);
+	if (!stream && !nrest && (bisectref != 0))
+	{
+		printf("\n    Reassignments: %d (last iteration: %d)", ls.totalchanges, ls.lastchanges);
+		printf("\n    Frozen groups: %d of %d (groups x iterations)", ls.nfrozen, NGROUPS * niter);
+	}
 	printf("\n    T_read:    %6.3f s", t_read);
 	printf("\n    T_clus:    %6.3f s", t_clus);
 	printf("\n    T_org:     %6.3f s", t_org);
@@ -282,7 +717,38 @@ void main(int argc, char *argv[])
 	printf("\n    T_anal:    %6.3f s", t_anal);
 	printf("\n    T_write:   %6.3f s", t_write);
 	printf("\n    ========================");
-	printf("\n    T_total:  %6.3f s\n\n", t_read + t_clus + t_org + t_compact + t_anal + t_write);
+	printf("\n    T_total:  %6.3f s\n", t_read + t_clus + t_org + t_compact + t_anal + t_write);
+
+	if (tuned == 2)
+		printf("\n    Tuning: calibrated in %.3f s, saved in %s", t_tune, TUNEFILE);
+	else if (tuned == 1)
+		printf("\n    Tuning: read from %s", TUNEFILE);
+	if (tuned)
+	{
+		tuneprint(&tu);
+		printf("\n");
+	}
+
+	printf("\n    Memory: %.1f MB reserved (%s pages)", arsize / 1048576.0,
+		   (ar.huge == 2) ? "huge" : (ar.huge == 1) ? "transparent huge" : "normal");
+	printf("\n             read    clus     org compact    anal");
+	printf("\n    MB    ");
+	for (i = 0; i < 5; i++)
+		printf("%8.1f", peak[i] / 1048576.0);
+	printf("\n    faults");
+	for (i = 0; i < 5; i++)
+		printf("%8ld", faults[i + 1] - faults[i]);
+	printf("\n\n    Footprint (MB)  original     now");
+	printf("\n    groups      %10.1f  %6.1f", (double)nelems * sizeof(int) / 1048576.0, (double)nelems * sizeof(gindex) / 1048576.0);
+	if (!stream)
+	{
+		printf("\n    members     %10.1f  %6.1f", (double)NGROUPS * sizeof(struct ginfo) / 1048576.0,
+			   (double)(nelems * sizeof(int) + sizeof(struct gcsr)) / 1048576.0);
+		printf("\n    diseases    %10.1f  %6.1f%s", (double)nelems * TDISEASE * sizeof(float) / 1048576.0,
+			   (quant && qd.exact) ? (double)nelems * TDISEASE / 1048576.0 : (double)nelems * TDISEASE * sizeof(float) / 1048576.0,
+			   quant ? (qd.exact ? " (quantized, exact)" : " (not quantized)") : "");
+	}
+	printf("\n\n");
 
 	printf("\n centroids 0, 40 and 80 and the compactness of their group\n ");
 	for (i = 0; i < NGROUPS; i += 40)
@@ -297,7 +763,7 @@ void main(int argc, char *argv[])
 	for (i = 0; i < NGROUPS / 10; i++)
 	{
 		for (j = 0; j < 10; j++)
-			printf("%6d", iingrs[10 * i + j].size);
+			printf("%6d", iingrs.size[10 * i + j]);
 		printf("\n");
 	}
 
@@ -0,0 +1,306 @@
+/*
+CA - OpenMP
+incgg_p.c
+Incremental re-clustering used in gengroups_p.c program (option -i)
+
+When new samples are appended to dbgen.dat and dbdise.dat, the groups of the previous run are a
+good start: the state file keeps its centroids, the additions of each group (sums and sizes),
+the sum of the distances of all the pairs of each group, the medians and the group of every
+element, with a checksum of the elements and of the diseases it was made from.
+  - Phase 1: the old elements keep their group, only the new ones are assigned to the nearest
+    centroid, and then at most INCIT Lloyd iterations refine all of them (see lloydgg_p.c)
+  - Phase 2: the pair sum of a group is updated with the distances of the elements that left or
+    joined it, and only the medians of the groups with changes are calculated again
+If the state file does not exist, or the old elements are not the first ones of the input, the
+run is a full one (and it writes the state for the next run). If only the diseases changed,
+Phase 1 is incremental and Phase 2 is a full one.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define INCMAGIC "GGINC001"
+
+// Checksum of the first n elements (one block)
+static unsigned long elemcrc(int n, float **elems)
+{
+	return crc32_z(0, (unsigned char *)elems[0], (size_t)n * NFEAT * sizeof(float));
+}
+
+/* 1 - Function to get the checksum of the diseases of the first n elements
+   Input:   dise    diseases (float32), or NULL to use the codes
+            qd      quantized diseases (the value of each code, so both give the same checksum)
+***************************************************************************************************/
+unsigned long incdisecrc(int n, float **dise, struct qdise *qd)
+{
+	unsigned long crc = 0;
+	float row[TDISEASE];
+
+	if (dise != NULL)
+		return crc32_z(0, (unsigned char *)dise[0], (size_t)n * TDISEASE * sizeof(float));
+	for (int i = 0; i < n; i++)
+	{
+		for (int d = 0; d < TDISEASE; d++)
+			row[d] = qd->book[d][qd->code[(size_t)i * TDISEASE + d]];
+		crc = crc32(crc, (unsigned char *)row, sizeof(row));
+	}
+	return crc;
+}
+
+/* 2 - Function to read the state of the previous run
+   Input:   fname   state file
+            nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            ar      arena for the old groups
+   Output:  inc     state; returns the number of elements of the previous run, 0 if the run must be a
+                    full one (no state file, other sizes, or the old elements are not the first ones)
+***************************************************************************************************/
+int incload(char *fname, int nelems, float **elems, struct incstate *inc, struct arena *ar)
+{
+	char magic[8];
+	int dims[4];
+	FILE *f;
+
+	inc->nprev = 0;
+	f = fopen(fname, "rb");
+	if (f == NULL)
+		return 0;
+
+	if ((fread(magic, 1, 8, f) != 8) || (memcmp(magic, INCMAGIC, 8) != 0) || (fread(dims, sizeof(int), 4, f) != 4) ||
+		(dims[0] != NFEAT) || (dims[1] != NGROUPS) || (dims[2] != TDISEASE) || (dims[3] < 1) || (dims[3] > nelems) ||
+		(fread(&inc->elemcrc, sizeof(unsigned long), 1, f) != 1) || (fread(&inc->disecrc, sizeof(unsigned long), 1, f) != 1) ||
+		(elemcrc(dims[3], elems) != inc->elemcrc))
+	{
+		printf("\n    Incremental: %s does not match the input, full run\n", fname);
+		fclose(f);
+		return 0;
+	}
+
+	inc->grind = (gindex *)arenaalloc(ar, dims[3] * sizeof(gindex));
+	if ((fread(inc->cent, sizeof(inc->cent), 1, f) != 1) || (fread(inc->add, sizeof(inc->add), 1, f) != 1) ||
+		(fread(inc->pairsum, sizeof(inc->pairsum), 1, f) != 1) || (fread(inc->medians, sizeof(inc->medians), 1, f) != 1) ||
+		(fread(inc->grind, sizeof(gindex), dims[3], f) != (size_t)dims[3]))
+	{
+		printf("\n    Incremental: %s is truncated, full run\n", fname);
+		fclose(f);
+		return 0;
+	}
+	fclose(f);
+
+	inc->nprev = dims[3];
+	return inc->nprev;
+}
+
+/* 3 - Function to start Phase 1 from the state: old groups, and new elements to the nearest centroid
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            inc     state of the previous run
+   Output:  cent    average of each group (the old centroid if the group is empty)
+            grind   group of each element
+            add     additions of each group, as lloyd needs them to start
+***************************************************************************************************/
+void incassign(int nelems, float **elems, struct incstate *inc, float cent[][NFEAT], gindex *grind, double add[][NFEAT + 1])
+{
+	int nprev = inc->nprev;
+
+	memcpy(cent, inc->cent, sizeof(inc->cent));
+	memcpy(add, inc->add, sizeof(inc->add));
+
+	// [*] the old elements keep their group, the new ones go to the nearest centroid
+	#pragma omp parallel default(none) shared(nelems, nprev, elems, inc, cent, grind, add)
+	{
+		double discent;
+
+		#pragma omp for schedule(static) nowait
+		for (int i = 0; i < nprev; i++)
+			grind[i] = inc->grind[i];
+
+		#pragma omp for schedule(static)
+		for (int i = nprev; i < nelems; i++)
+			grind[i] = nearestcentroid(elems[i], cent, NGROUPS, &discent);
+
+		// [*] each thread adds the new elements of its groups, in order (no reduction, same result
+		// with any number of threads)
+		#pragma omp for schedule(dynamic)
+		for (int g = 0; g < NGROUPS; g++)
+		{
+			for (int i = nprev; i < nelems; i++)
+				if (grind[i] == g)
+				{
+					for (int j = 0; j < NFEAT; j++)
+						add[g][j] += elems[i][j];
+					add[g][NFEAT]++;
+				}
+			if (add[g][NFEAT] > 0)
+				movecentroid(add[g], cent[g]);
+		}
+	}
+}
+
+// Sum of the distances between the elements of set (in a group) and all the other members of the
+// group; the pairs with both elements in the set are counted once
+static double leavejoin(float **elems, int *members, int gsize, int *set, int nset, char *inset)
+{
+	double sum = 0.0;
+
+	for (int a = 0; a < nset; a++)
+		for (int k = 0; k < gsize; k++)
+		{
+			int y = members[k];
+			if ((y != set[a]) && (!inset[k] || (y > set[a])))
+				sum += geneticdistance(elems[set[a]], elems[y]);
+		}
+	return sum;
+}
+
+/* 4 - Function to update the compactness and the medians of the groups from the state
+   Input:   elems   elements (nelems x NFEAT)
+            dise    diseases (nelems x TDISEASE), or NULL to use the codes of qd
+            grind   group of each element
+            iingrs  size and members of each group
+            inc     state of the previous run (the diseases of the old elements must be the same)
+            ar      arena for the members of the old groups and the buffers of the medians
+   Output:  compact compactness of each group
+            medians median of each disease in each group
+            inc     pair sums, updated
+            returns the number of groups with changes
+***************************************************************************************************/
+int incanalysis(float **elems, float **dise, struct qdise *qd, gindex *grind, struct gcsr *iingrs,
+				struct incstate *inc, float *compact, float medians[][TDISEASE], struct arena *ar)
+{
+	size_t mark = arenamark(ar);
+	struct gcsr oldgrs;
+	int nprev = inc->nprev, nupd = 0;
+
+	oldgrs.members = (int *)arenaalloc(ar, nprev * sizeof(int));
+	groupmembers(nprev, inc->grind, &oldgrs, ar);
+
+	// [*] groups are independent; dynamic: the work depends on the size and the changes of each group
+	#pragma omp parallel for default(none) shared(nprev, elems, dise, qd, grind, iingrs, oldgrs, inc, compact, medians, ar) \
+		reduction(+: nupd) schedule(dynamic)
+	for (int g = 0; g < NGROUPS; g++)
+	{
+		int *om = oldgrs.members + oldgrs.first[g], *nm = iingrs->members + iingrs->first[g];
+		int osize = oldgrs.size[g], gsize = iingrs->size[g], nr = 0, na = 0, k;
+		int *rem = (int *)arenaalloc(ar, (osize + gsize) * sizeof(int)), *add = rem + osize;
+		char *inr = (char *)arenaalloc(ar, osize + gsize), *ina = inr + osize;
+		double sum = inc->pairsum[g], full = (double)gsize * (gsize - 1) / 2;
+
+		// elements that left the group, and elements that joined it (new, or from another group)
+		for (k = 0; k < osize; k++)
+			if ((inr[k] = (grind[om[k]] != g)))
+				rem[nr++] = om[k];
+		for (k = 0; k < gsize; k++)
+			if ((ina[k] = ((nm[k] >= nprev) || (inc->grind[nm[k]] != g))))
+				add[na++] = nm[k];
+		if ((nr == 0) && (na == 0))
+		{
+			memcpy(medians[g], inc->medians[g], sizeof(medians[g]));
+			compact[g] = (gsize <= 1) ? 0.0 : (float)(sum / ((double)gsize * (gsize - 1) / 2));
+			continue;
+		}
+		nupd++;
+
+		// pair sum: minus the pairs of the elements that left, plus those of the elements that joined,
+		// or all the pairs again if it is less work
+		if ((double)nr * osize + (double)na * gsize < full)
+			sum = sum - leavejoin(elems, om, osize, rem, nr, inr) + leavejoin(elems, nm, gsize, add, na, ina);
+		else
+		{
+			sum = 0.0;
+			for (int j = 0; j < gsize; j++)
+				for (k = j + 1; k < gsize; k++)
+					sum += geneticdistance(elems[nm[j]], elems[nm[k]]);
+		}
+		if (gsize <= 1)
+			sum = 0.0;
+		inc->pairsum[g] = sum;
+		compact[g] = (gsize <= 1) ? 0.0 : (float)(sum / ((double)gsize * (gsize - 1) / 2));
+
+		// medians of the group, as in analysistasks
+		if (gsize == 0)
+			continue;
+		if (dise != NULL)
+		{
+			float *list = (float *)arenaalloc(ar, gsize * sizeof(float));
+			for (int d = 0; d < TDISEASE; d++)
+			{
+				for (k = 0; k < gsize; k++)
+					list[k] = dise[nm[k]][d];
+				medians[g][d] = groupmedian(list, gsize);
+			}
+		}
+		else
+		{
+			unsigned char *codes = (unsigned char *)arenaalloc(ar, gsize);
+			for (int d = 0; d < TDISEASE; d++)
+			{
+				for (k = 0; k < gsize; k++)
+					codes[k] = qd->code[(size_t)nm[k] * TDISEASE + d];
+				medians[g][d] = qmedian(codes, gsize, qd->book[d]);
+			}
+		}
+	}
+
+	arenarelease(ar, mark);
+	return nupd;
+}
+
+/* 5 - Function to write the state of this run for the next one
+   Input:   fname   state file
+            nelems  number of elements
+            elems, dise, qd: elements and diseases, for the checksums
+            iingrs  size and members of each group
+            cent    centroids
+            medians median of each disease in each group
+            grind   group of each element
+            inc     pair sum of each group
+***************************************************************************************************/
+void incsave(char *fname, int nelems, float **elems, float **dise, struct qdise *qd, struct gcsr *iingrs,
+			 float cent[][NFEAT], float medians[][TDISEASE], gindex *grind, struct incstate *inc)
+{
+	int dims[4] = {NFEAT, NGROUPS, TDISEASE, nelems};
+	char tmp[4096];
+	FILE *f;
+
+	inc->elemcrc = elemcrc(nelems, elems);
+	inc->disecrc = incdisecrc(nelems, dise, qd);
+	memcpy(inc->cent, cent, sizeof(inc->cent));
+	memcpy(inc->medians, medians, sizeof(inc->medians));
+
+	// [*] additions of each group from its members, in order
+	#pragma omp parallel for default(none) shared(elems, iingrs, inc) schedule(dynamic)
+	for (int g = 0; g < NGROUPS; g++)
+	{
+		memset(inc->add[g], 0, sizeof(inc->add[g]));
+		for (int k = iingrs->first[g]; k < iingrs->first[g + 1]; k++)
+			for (int j = 0; j < NFEAT; j++)
+				inc->add[g][j] += elems[iingrs->members[k]][j];
+		inc->add[g][NFEAT] = iingrs->size[g];
+	}
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+	f = fopen(tmp, "wb");
+	if (f == NULL)
+	{
+		printf("Error when opening file %s \n", tmp);
+		return;
+	}
+	fwrite(INCMAGIC, 1, 8, f);
+	fwrite(dims, sizeof(int), 4, f);
+	fwrite(&inc->elemcrc, sizeof(unsigned long), 1, f);
+	fwrite(&inc->disecrc, sizeof(unsigned long), 1, f);
+	fwrite(inc->cent, sizeof(inc->cent), 1, f);
+	fwrite(inc->add, sizeof(inc->add), 1, f);
+	fwrite(inc->pairsum, sizeof(inc->pairsum), 1, f);
+	fwrite(inc->medians, sizeof(inc->medians), 1, f);
+	fwrite(grind, sizeof(gindex), nelems, f);
+	if (fclose(f) == 0)
+		rename(tmp, fname);
+}
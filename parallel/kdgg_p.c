@@ -0,0 +1,399 @@
+/*
+CA - OpenMP
+kdgg_p.c
+KD-tree filtering engine for Phase 1 used in gengroups_p.c program (option -a kd)
+
+The brute force classification computes NGROUPS distances for every element in every iteration.
+The filtering algorithm (Kanungo et al.) builds a kd-tree of the elements once, with the bounding
+box, the sum and the number of the elements of every node. Each iteration goes down the tree with
+a list of candidate centroids: a candidate is dropped from a node when every point of the box is
+farther from it than from the candidate nearest to the middle of the box (the test is exact: the
+difference of the squared distances is linear, so it is checked at one vertex of the box). When
+only one candidate is left, the whole node goes to its group with its sum, without any distance.
+With well separated groups most of the nodes are decided high in the tree.
+  - build: split at the median of the widest feature; big nodes are split in tasks
+  - traversal: one task per subtree of more than KDTASK elements, additions per thread
+Candidates are only dropped with a margin, and the leaves check the candidates in increasing
+order, so the groups are the ones of nearestcentroid (first centroid if there is a tie).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define KDMARGIN 1e-6	//relative margin of the test to drop a candidate (geneticdistance rounds ~1e-7)
+
+struct kdwork              // data of one iteration, shared by the tasks
+{
+ struct kdtree *kt;
+ float        **elems;
+ float        (*cent)[NFEAT];
+ gindex        *grind;
+ double       (*tadd)[NGROUPS][NFEAT + 1]; // additions of each thread
+ int          (*tchanged)[NGROUPS];        // groups with changes found by each thread
+ double        *tsumsq;    // squared norms of the elements of each group, per thread (telemetry only)
+ long          *tstat;     // per thread: reassignments and distances (also those of the tests), KDSTAT longs each
+};
+
+#define KDSTAT 8
+
+// Squared distance in double (the test of the candidates)
+static double sqdist(float *a, float *b)
+{
+	double d = 0.0, t;
+
+	for (int j = 0; j < NFEAT; j++)
+	{
+		t = (double)a[j] - b[j];
+		d += t * t;
+	}
+	return d;
+}
+
+// k-th smallest element of idx[0 .. n) in feature d moved to position k, smaller ones before it
+static void kdselect(float **elems, int *idx, int n, int k, int d)
+{
+	int lo = 0, hi = n - 1;
+
+	while (lo < hi)
+	{
+		float pivot = elems[idx[(lo + hi) / 2]][d];
+		int i = lo, j = hi, aux;
+
+		while (i <= j)
+		{
+			while (elems[idx[i]][d] < pivot)
+				i++;
+			while (elems[idx[j]][d] > pivot)
+				j--;
+			if (i <= j)
+			{
+				aux = idx[i];
+				idx[i] = idx[j];
+				idx[j] = aux;
+				i++;
+				j--;
+			}
+		}
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			return;
+	}
+}
+
+// Node with elements idx[first .. first + n): box, then children (split in tasks if it is big), then sum
+static void kdbuild(struct kdtree *kt, float **elems, int node, int first, int n)
+{
+	struct kdnode *nd = &kt->nodes[node];
+	int j, k, d = 0;
+
+	nd->first = first;
+	nd->n = n;
+	for (j = 0; j < NFEAT; j++)
+	{
+		nd->lo[j] = FLT_MAX;
+		nd->hi[j] = -FLT_MAX;
+	}
+	for (k = first; k < first + n; k++)
+		for (j = 0; j < NFEAT; j++)
+		{
+			float v = elems[kt->idx[k]][j];
+			if (v < nd->lo[j])
+				nd->lo[j] = v;
+			if (v > nd->hi[j])
+				nd->hi[j] = v;
+		}
+
+	for (j = 1; j < NFEAT; j++)
+		if (nd->hi[j] - nd->lo[j] > nd->hi[d] - nd->lo[d])
+			d = j;
+
+	if ((n <= KDLEAF) || (nd->hi[d] == nd->lo[d]))
+	{
+		nd->left = nd->right = -1;
+		memset(nd->sum, 0, sizeof(nd->sum));
+		nd->sumsq = 0.0;
+		for (k = first; k < first + n; k++)
+			for (j = 0; j < NFEAT; j++)
+			{
+				nd->sum[j] += elems[kt->idx[k]][j];
+				nd->sumsq += (double)elems[kt->idx[k]][j] * elems[kt->idx[k]][j];
+			}
+		return;
+	}
+
+	kdselect(elems, kt->idx + first, n, n / 2, d);
+	nd->left = __atomic_fetch_add(&kt->nnodes, 2, __ATOMIC_RELAXED);
+	nd->right = nd->left + 1;
+
+	// [*] the two halves are independent; small ones are not worth a task
+	#pragma omp task default(none) shared(kt, elems) firstprivate(nd, first, n) if(n > KDTASK)
+	kdbuild(kt, elems, nd->left, first, n / 2);
+	#pragma omp task default(none) shared(kt, elems) firstprivate(nd, first, n) if(n > KDTASK)
+	kdbuild(kt, elems, nd->right, first + n / 2, n - n / 2);
+	#pragma omp taskwait
+
+	for (j = 0; j < NFEAT; j++)
+		nd->sum[j] = kt->nodes[nd->left].sum[j] + kt->nodes[nd->right].sum[j];
+	nd->sumsq = kt->nodes[nd->left].sumsq + kt->nodes[nd->right].sumsq;
+}
+
+/* 1 - Function to build the kd-tree of the elements
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            ar      arena for the tree (kept until the end of the run)
+   Output:  kt      tree
+***************************************************************************************************/
+void kdtreebuild(int nelems, float **elems, struct kdtree *kt, struct arena *ar)
+{
+	kt->maxnodes = 4 * (nelems / KDLEAF) + 3; // median splits: leaves of more than KDLEAF / 2 elements
+	kt->nodes = (struct kdnode *)arenaalloc(ar, kt->maxnodes * sizeof(struct kdnode));
+	kt->idx = (int *)arenaalloc(ar, nelems * sizeof(int));
+	kt->nnodes = 1;
+
+	#pragma omp parallel for
+	for (int i = 0; i < nelems; i++)
+		kt->idx[i] = i;
+
+	#pragma omp parallel default(none) shared(kt, elems, nelems)
+	#pragma omp single
+	kdbuild(kt, elems, 0, 0, nelems);
+}
+
+// All the elements of a node to group g
+static void kdassign(struct kdwork *w, struct kdnode *nd, int g, double (*add)[NFEAT + 1], int *changed, long *stat)
+{
+	int *idx = w->kt->idx;
+
+	for (int k = nd->first; k < nd->first + nd->n; k++)
+		if (w->grind[idx[k]] != g)
+		{
+			if (w->grind[idx[k]] != GNONE)
+				changed[w->grind[idx[k]]] = 1;
+			changed[g] = 1;
+			w->grind[idx[k]] = g;
+			stat[0]++;
+		}
+	for (int j = 0; j < NFEAT; j++)
+		add[g][j] += nd->sum[j];
+	add[g][NFEAT] += nd->n;
+	if (w->tsumsq != NULL)
+		w->tsumsq[omp_get_thread_num() * NGROUPS + g] += nd->sumsq;
+}
+
+// Filtering of the candidates cand[0 .. nc) (in increasing order) in a node
+static void kdfilter(struct kdwork *w, int node, int *cand, int nc)
+{
+	struct kdnode *nd = &w->kt->nodes[node];
+	int tid = omp_get_thread_num();
+	double (*add)[NFEAT + 1] = w->tadd[tid];
+	int *changed = w->tchanged[tid];
+	long *stat = w->tstat + (size_t)tid * KDSTAT;
+	int keep[NGROUPS], nk = 0, best = 0, j, c;
+	float mid[NFEAT], v[NFEAT];
+	double d, db, diag2, bestd = DBL_MAX;
+
+	if (nc == 1)
+	{
+		kdassign(w, nd, cand[0], add, changed, stat);
+		return;
+	}
+
+	if (nd->left < 0)
+	{
+		// leaf: nearest candidate of every element, in increasing order as nearestcentroid
+		for (int k = nd->first; k < nd->first + nd->n; k++)
+		{
+			int i = w->kt->idx[k], g = cand[0];
+			double min_d = DBL_MAX;
+
+			for (c = 0; c < nc; c++)
+			{
+				d = geneticdistance(w->elems[i], w->cent[cand[c]]);
+				if (d < min_d)
+				{
+					min_d = d;
+					g = cand[c];
+				}
+			}
+			stat[1] += nc;
+			if (w->grind[i] != g)
+			{
+				if (w->grind[i] != GNONE)
+					changed[w->grind[i]] = 1;
+				changed[g] = 1;
+				w->grind[i] = g;
+				stat[0]++;
+			}
+			for (j = 0; j < NFEAT; j++)
+				add[g][j] += w->elems[i][j];
+			add[g][NFEAT]++;
+			if (w->tsumsq != NULL)
+				for (j = 0; j < NFEAT; j++)
+					w->tsumsq[tid * NGROUPS + g] += (double)w->elems[i][j] * w->elems[i][j];
+		}
+		return;
+	}
+
+	// candidate nearest to the middle of the box
+	for (j = 0; j < NFEAT; j++)
+		mid[j] = 0.5f * (nd->lo[j] + nd->hi[j]);
+	for (c = 0; c < nc; c++)
+		if ((d = sqdist(mid, w->cent[cand[c]])) < bestd)
+		{
+			bestd = d;
+			best = cand[c];
+		}
+	stat[1] += nc;
+
+	// a candidate stays if it is nearer than best at the vertex of the box in its direction, or not
+	// farther by more than the rounding of the leaves: for any element x of the box, |x - z|^2 is at
+	// most 2 |v - z|^2 + 2 diag^2 (and the same for zb), so the margin is taken on that bound
+	diag2 = sqdist(nd->lo, nd->hi);
+	for (c = 0; c < nc; c++)
+	{
+		float *z = w->cent[cand[c]], *zb = w->cent[best];
+
+		if (cand[c] != best)
+		{
+			for (j = 0; j < NFEAT; j++)
+				v[j] = (z[j] > zb[j]) ? nd->hi[j] : nd->lo[j];
+			d = sqdist(z, v);
+			db = sqdist(zb, v);
+			if (d - db > KDMARGIN * (d + db + 2.0 * diag2))
+				continue;
+		}
+		keep[nk++] = cand[c];
+	}
+	stat[1] += 2 * (nc - 1);
+
+	if (nk == 1)
+	{
+		kdassign(w, nd, best, add, changed, stat);
+		return;
+	}
+
+	// [*] big subtrees as tasks, each one with its own copy of the candidates
+	#pragma omp task default(none) shared(w) firstprivate(nd, keep, nk) if(nd->n > KDTASK)
+	kdfilter(w, nd->left, keep, nk);
+	#pragma omp task default(none) shared(w) firstprivate(nd, keep, nk) if(nd->n > KDTASK)
+	kdfilter(w, nd->right, keep, nk);
+	#pragma omp taskwait
+}
+
+/* 2 - Function to classify the elements and calculate the centroids until convergence with the tree
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            kt      kd-tree of the elements
+            cent    first centroids (NGROUPS x NFEAT)
+            ar      arena for the additions (total and of each thread)
+            maxit   maximum number of iterations
+   Output:  cent    final centroids
+            grind   group of each element
+            ls      iterations, reassignments and frozen groups, as lloyd
+            returns the distances calculated, to compare with nelems x NGROUPS per iteration
+***************************************************************************************************/
+long kdlloyd(int nelems, float **elems, struct kdtree *kt, float cent[][NFEAT], gindex *grind, struct lloydstats *ls,
+			 struct arena *ar, int maxit)
+{
+	int nthr = omp_get_max_threads();
+	size_t mark = arenamark(ar);
+	struct kdwork w;
+	double (*additions)[NFEAT + 1], shift, maxshift, inertia;
+	int *changed, *all, finish = 0, niter = 0, nchanges = 0, g, j;
+	long ndist = 0;
+
+	additions = arenaalloc(ar, NGROUPS * sizeof(*additions));
+	changed = (int *)arenaalloc(ar, NGROUPS * sizeof(int));
+	all = (int *)arenaalloc(ar, NGROUPS * sizeof(int));
+	w.kt = kt;
+	w.elems = elems;
+	w.cent = cent;
+	w.grind = grind;
+	w.tadd = arenaalloc(ar, nthr * sizeof(*w.tadd));
+	w.tchanged = arenaalloc(ar, nthr * sizeof(*w.tchanged));
+	w.tsumsq = (telemetry != NULL) ? (double *)arenaalloc(ar, nthr * NGROUPS * sizeof(double)) : NULL;
+	w.tstat = (long *)arenaalloc(ar, nthr * KDSTAT * sizeof(long));
+	memset(w.tstat, 0, nthr * KDSTAT * sizeof(long));
+	ls->totalchanges = ls->nfrozen = 0;
+
+	#pragma omp parallel for
+	for (int i = 0; i < nelems; i++)
+		grind[i] = GNONE; // no element has a group yet
+	for (g = 0; g < NGROUPS; g++)
+		all[g] = g;
+
+	while ((finish == 0) && (niter < maxit))
+	{
+		memset(w.tadd, 0, nthr * sizeof(*w.tadd));
+		memset(w.tchanged, 0, nthr * sizeof(*w.tchanged));
+		if (w.tsumsq != NULL)
+			memset(w.tsumsq, 0, nthr * NGROUPS * sizeof(double));
+
+		#pragma omp parallel default(none) shared(w, all)
+		#pragma omp single
+		kdfilter(&w, 0, all, NGROUPS);
+
+		// additions and changes of the threads, in thread order
+		memset(additions, 0, NGROUPS * sizeof(*additions));
+		memset(changed, 0, NGROUPS * sizeof(int));
+		nchanges = 0;
+		for (int t = 0; t < nthr; t++)
+		{
+			for (g = 0; g < NGROUPS; g++)
+			{
+				for (j = 0; j < NFEAT + 1; j++)
+					additions[g][j] += w.tadd[t][g][j];
+				changed[g] |= w.tchanged[t][g];
+			}
+			nchanges += w.tstat[t * KDSTAT];
+			w.tstat[t * KDSTAT] = 0;
+		}
+
+		// groups without changes do not move, as in lloyd
+		// inertia of the iteration: from the sum and the sum of squares of each group
+		finish = 1;
+		maxshift = 0.0;
+		inertia = 0.0;
+		for (g = 0; g < NGROUPS; g++)
+		{
+			if (telemetry != NULL)
+			{
+				for (j = 0; j < NFEAT; j++)
+					inertia += additions[g][NFEAT] * cent[g][j] * cent[g][j] - 2.0 * cent[g][j] * additions[g][j];
+				for (int t = 0; t < nthr; t++)
+					inertia += w.tsumsq[t * NGROUPS + g];
+			}
+			if (!changed[g])
+				ls->nfrozen++;
+			else if (additions[g][NFEAT] > 0)
+			{
+				shift = movecentroid(additions[g], cent[g]);
+				if (shift > DELTA)
+					finish = 0;
+				if (shift > maxshift)
+					maxshift = shift;
+			}
+		}
+
+		niter++;
+		ls->totalchanges += nchanges;
+		if (telemetry != NULL)
+			teleline(telemetry, niter, nchanges, maxshift, inertia, finish || (niter == maxit));
+	}
+
+	ls->niter = niter;
+	ls->lastchanges = nchanges;
+	for (int t = 0; t < nthr; t++)
+		ndist += w.tstat[t * KDSTAT + 1];
+	arenarelease(ar, mark);
+	return ndist;
+}
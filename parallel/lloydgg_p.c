@@ -0,0 +1,320 @@
+/*
+CA - OpenMP
+lloydgg_p.c
+Phase 1 of gengroups_p.c program (in-memory version): Lloyd iterations in one persistent parallel region
+
+The whole while loop runs inside one team, so there is no fork/join per iteration, and there are
+two barriers per iteration:
+  - every thread classifies its (static) range of elements and writes the changes of group in its
+    own partial: additions delta, changed groups and number of reassignments
+  - barrier
+  - every thread owns a fixed block of NGROUPS/nt groups: it adds the rows of those groups of all
+    the partials, in thread order, to the shared additions, and moves their centroids (and projected
+    centroids). The reduction is O(NGROUPS*NFEAT) per thread, not nt times that
+  - barrier: all the centroids are new; every thread takes the maximum of the shifts of the blocks,
+    so all of them take the same decision to finish
+A partial is only read between the two barriers, so the thread can write it again in the next
+iteration without another buffer.
+Groups without changes are frozen as before (see newcentroids): their partial rows are zero and are
+neither added nor cleared.
+The partial of each thread comes from its own scratch sub-arena (ARENASCRATCH grows with NGROUPS),
+in the pages first touched by that thread and not on its stack; the shared additions, projected
+centroids and shifts come from the scratch of thread 0.
+
+The changes are added in thread order, but the elements of each thread depend on the number of
+threads, so the last bits of the centroids do too. The deterministic mode (lloyddet) adds fixed
+blocks of elements in a fixed tree instead, and gives the same bits with any number of threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+/* 1 - Function to classify the elements and calculate the centroids until convergence
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            cent    first centroids (NGROUPS x NFEAT)
+            scratch scratch sub-arena of each thread
+            maxit   maximum number of iterations (MAXIT, or less for the autotuning)
+            warm    NULL, or additions of the groups in grind (warm start: grind has a group for every
+                    element, and cent must be the average of each non empty group)
+            weight  NULL, or weight of each element in the additions (coreset mode, see coregg_p.c)
+            pj      NULL, or projection of the elements to find the closest centroid with bounds
+                    (see projgg_p.c)
+   Output:  cent    final centroids
+            grind   group of each element
+            ls      iterations, reassignments, frozen groups and exact distances (with pj)
+***************************************************************************************************/
+void lloyd(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct lloydstats *ls, struct arena *scratch, int maxit,
+		   double warm[][NFEAT + 1], float *weight, struct projection *pj)
+{
+	int nthr = omp_get_max_threads();
+	struct partial *part[nthr];             // partial of each thread
+	size_t mark0 = arenamark(&scratch[0]);
+	// shared by the team: additions of the groups, projected centroids (with pj) and shift of each block
+	double (*add)[NFEAT + 1] = arenaalloc(&scratch[0], NGROUPS * sizeof(*add));
+	double *pcent = (pj == NULL) ? NULL : arenaalloc(&scratch[0], NGROUPS * pj->r * sizeof(double));
+	double *bshift = arenaalloc(&scratch[0], nthr * sizeof(double));
+
+	if (warm == NULL)
+	{
+		memset(add, 0, NGROUPS * sizeof(*add));
+		#pragma omp parallel for
+		for (int i = 0; i < nelems; i++)
+			grind[i] = GNONE; // no element has a group yet
+	}
+	else
+		memcpy(add, warm, NGROUPS * sizeof(*add));
+	if (pj != NULL)
+		projcent(pj, cent, pcent, 0, NGROUPS);
+	ls->nexact = 0;
+	ls->nfrozen = 0;
+
+	#pragma omp parallel default(none) shared(nelems, elems, cent, grind, ls, part, scratch, maxit, add, pcent, bshift, weight, pj, telemetry)
+	{
+		int tid = omp_get_thread_num(), nt = omp_get_num_threads();
+		int g0 = tid * NGROUPS / nt, g1 = (tid + 1) * NGROUPS / nt; // block of groups of this thread
+		size_t mark = arenamark(&scratch[tid]);
+		long nexact = 0;
+		int finish = 0, niter = 0, nchanges = 0, totalchanges = 0, nfrozen = 0, changed;
+		int i, j, g, group, oldgroup;
+		double discent, shift, maxshift, inertia, w;
+		struct partial *p, *q;
+
+		p = part[tid] = arenaalloc(&scratch[tid], sizeof(struct partial));
+		memset(p, 0, sizeof(struct partial));
+		#pragma omp barrier
+
+		while ((finish == 0) && (niter < maxit))
+		{
+			// clear the rows used the last time this partial was written
+			for (g = 0; g < NGROUPS; g++)
+				if (p->changed[g])
+				{
+					memset(p->add[g], 0, sizeof(p->add[g]));
+					p->changed[g] = 0;
+				}
+			p->nchanges = 0;
+			p->inertia = 0.0;
+
+			// Obtain the closest group of each element; only the elements that change group go to the partial
+			// [*] runtime schedule: static by default (same elements for this thread in every iteration),
+			// or the one of the autotuning (see tunegg_p.c); no barrier (nowait)
+			#pragma omp for schedule(runtime) nowait
+			for (i = 0; i < nelems; i++)
+			{
+				if (pj == NULL)
+					group = nearestcentroid(elems[i], cent, NGROUPS, &discent);
+				else
+					group = projnearest(pj, i, elems[i], cent, pcent, &discent, &nexact);
+				w = (weight == NULL) ? 1.0 : weight[i];
+				p->inertia += w * discent * discent;
+				oldgroup = grind[i];
+				if (group != oldgroup)
+				{
+					grind[i] = group;
+					p->nchanges++;
+					p->changed[group] = 1;
+					for (j = 0; j < NFEAT; j++)
+						p->add[group][j] += w * elems[i][j];
+					p->add[group][NFEAT] += w;
+					if (oldgroup != GNONE)
+					{
+						p->changed[oldgroup] = 1;
+						for (j = 0; j < NFEAT; j++)
+							p->add[oldgroup][j] -= w * elems[i][j];
+						p->add[oldgroup][NFEAT] -= w;
+					}
+				}
+			}
+
+			// [*] all the partials are complete
+			#pragma omp barrier
+
+			// [*] counters of the iteration: every thread adds them (one value per partial)
+			nchanges = 0;
+			inertia = 0.0;
+			for (int t = 0; t < nt; t++)
+			{
+				nchanges += part[t]->nchanges;
+				inertia += part[t]->inertia;
+			}
+
+			// [*] reduction of the block of groups of this thread, in thread order, and new centroids
+			// of the groups of the block that are not frozen
+			maxshift = 0.0;
+			for (g = g0; g < g1; g++)
+			{
+				changed = 0;
+				for (int t = 0; t < nt; t++)
+				{
+					q = part[t];
+					if (q->changed[g])
+					{
+						changed = 1;
+						for (j = 0; j < NFEAT + 1; j++)
+							add[g][j] += q->add[g][j];
+					}
+				}
+				if (!changed)
+					nfrozen++;
+				else if (add[g][NFEAT] > 0)
+				{
+					shift = movecentroid(add[g], cent[g]);
+					if (shift > maxshift)
+						maxshift = shift;
+				}
+			}
+			if (pj != NULL)
+				projcent(pj, cent, pcent, g0, g1);
+			bshift[tid] = maxshift;
+
+			// [*] all the blocks are moved (nobody reads the partials again in this iteration)
+			#pragma omp barrier
+
+			// decision to finish: the same maximum shift in all the threads
+			for (int t = 0; t < nt; t++)
+				if (bshift[t] > maxshift)
+					maxshift = bshift[t];
+			finish = (maxshift <= DELTA);
+
+			niter++;
+			totalchanges += nchanges;
+
+			// telemetry: one line, written by the master thread (all the threads have the same values)
+			if (telemetry != NULL)
+			{
+				#pragma omp master
+				teleline(telemetry, niter, nchanges, maxshift, inertia, finish || (niter == maxit));
+			}
+		} // while
+
+		#pragma omp atomic
+		ls->nexact += nexact;
+		#pragma omp atomic
+		ls->nfrozen += nfrozen;
+
+		// all the threads have the same values
+		#pragma omp master
+		{
+			ls->niter = niter;
+			ls->totalchanges = totalchanges;
+			ls->lastchanges = nchanges;
+		}
+		arenarelease(&scratch[tid], mark);
+	}
+	arenarelease(&scratch[0], mark0);
+}
+
+/* 2 - Function to classify the elements and calculate the centroids with the same result for any
+       number of threads (deterministic mode, option -e)
+   Input:   as lloyd; keep is 1 if grind already has a group for every element (warm start)
+            ar      arena for the sums of the blocks
+   Output:  as lloyd
+   [*] the elements are split in fixed blocks of DETBLOCK elements, and every iteration the sums of
+   each block are calculated again from scratch (no deltas, whose order depends on the threads).
+   The blocks are added in a fixed tree (pairs of blocks, then pairs of pairs...), so the
+   additions only depend on nelems
+***************************************************************************************************/
+void lloyddet(int nelems, float **elems, float cent[][NFEAT], gindex *grind, struct lloydstats *ls, struct arena *ar, int maxit,
+			  int keep)
+{
+	int nblocks = (nelems + DETBLOCK - 1) / DETBLOCK;
+	size_t mark = arenamark(ar);
+	struct partial *part = (struct partial *)arenaalloc(ar, nblocks * sizeof(struct partial));
+	int finish = 0, niter = 0, totalchanges = 0, nfrozen = 0;
+
+	if (!keep)
+	{
+		#pragma omp parallel for
+		for (int i = 0; i < nelems; i++)
+			grind[i] = GNONE; // no element has a group yet
+	}
+
+	#pragma omp parallel default(none) shared(nelems, elems, cent, grind, ls, part, nblocks, maxit, finish, niter, totalchanges, nfrozen, telemetry)
+	{
+		double discent;
+		int g, j;
+
+		while ((finish == 0) && (niter < maxit))
+		{
+			// [*] sums of each block, in the order of its elements; the block, not the thread, is the unit
+			#pragma omp for schedule(static)
+			for (int b = 0; b < nblocks; b++)
+			{
+				struct partial *p = &part[b];
+				int last = (b + 1) * DETBLOCK < nelems ? (b + 1) * DETBLOCK : nelems;
+
+				memset(p, 0, sizeof(struct partial));
+				for (int i = b * DETBLOCK; i < last; i++)
+				{
+					int group = nearestcentroid(elems[i], cent, NGROUPS, &discent);
+					p->inertia += discent * discent;
+					if (group != grind[i])
+					{
+						if (grind[i] != GNONE)
+							p->changed[grind[i]] = 1;
+						p->changed[group] = 1;
+						p->nchanges++;
+						grind[i] = group;
+					}
+					for (j = 0; j < NFEAT; j++)
+						p->add[group][j] += elems[i][j];
+					p->add[group][NFEAT]++;
+				}
+			}
+
+			// [*] fixed tree of additions: level by level, block b gets block b + step
+			for (int step = 1; step < nblocks; step *= 2)
+			{
+				#pragma omp for schedule(static)
+				for (int b = 0; b < nblocks - step; b += 2 * step)
+				{
+					struct partial *p = &part[b], *q = &part[b + step];
+					for (g = 0; g < NGROUPS; g++)
+					{
+						if (q->add[g][NFEAT] > 0)
+							for (j = 0; j < NFEAT + 1; j++)
+								p->add[g][j] += q->add[g][j];
+						p->changed[g] |= q->changed[g];
+					}
+					p->nchanges += q->nchanges;
+					p->inertia += q->inertia;
+				}
+			}
+
+			// new centroids of the groups with changes (the others would not move), and decision to finish
+			#pragma omp single
+			{
+				double shift, maxshift = 0.0;
+
+				finish = 1;
+				for (g = 0; g < NGROUPS; g++)
+					if (!part[0].changed[g])
+						nfrozen++;
+					else if (part[0].add[g][NFEAT] > 0)
+					{
+						shift = movecentroid(part[0].add[g], cent[g]);
+						if (shift > DELTA)
+							finish = 0;
+						if (shift > maxshift)
+							maxshift = shift;
+					}
+				niter++;
+				totalchanges += part[0].nchanges;
+				ls->lastchanges = part[0].nchanges;
+				if (telemetry != NULL)
+					teleline(telemetry, niter, part[0].nchanges, maxshift, part[0].inertia, finish || (niter == maxit));
+			} // implicit barrier: every thread sees the same decision
+		} // while
+	}
+
+	ls->niter = niter;
+	ls->totalchanges = totalchanges;
+	ls->nfrozen = nfrozen;
+	arenarelease(ar, mark);
+}
@@ -0,0 +1,176 @@
+/*
+CA - OpenMP
+pipegg_p.c
+Pipelined input / output used in gengroups_p.c program (option -p), and the routines
+that write each section of results_p.out
+
+The disease matrix is not needed until the analysis of Phase 2, so a loader thread reads
+dbdise.dat while the k-means iterations run. The results file is written by a writer thread,
+section by section, as soon as the data of each section is final: centroids and sizes right
+after the members of the groups are known, so they are written while the compactness and the
+medians are calculated. In memory, compactness and medians come from the same graph of tasks
+(see taskgg_p.c), so the compactness is only final with the medians and is written while the
+maximum and minimum medians are found; in streaming mode it is written while the diseases are
+analysed. The diseases are written at the end.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+// Loader thread: read the diseases of nelems elements (dise is already allocated), or their codes
+static void *loaddise(void *arg)
+{
+	struct pipeline *pl = (struct pipeline *)arg;
+	FILE *f1;
+	int i, j;
+
+	if (pl->qd != NULL)
+	{
+		pl->dise = readqdise(pl->fname, pl->nelems, pl->qd);
+		return NULL;
+	}
+
+	f1 = zopen(pl->fname);
+	if (f1 == NULL)
+	{
+		printf("Error opening file %s \n", pl->fname);
+		exit(-1);
+	}
+
+	for (i = 0; i < pl->nelems; i++)
+		for (j = 0; j < TDISEASE; j++)
+			fscanf(f1, "%f", &pl->dise[i][j]);
+
+	fclose(f1);
+	return NULL;
+}
+
+// Writer thread: write each section when its stage is reached
+static void *writeresults(void *arg)
+{
+	struct pipeline *pl = (struct pipeline *)arg;
+
+	for (int s = 1; s <= 3; s++)
+	{
+		pthread_mutex_lock(&pl->lock);
+		while (pl->stage < s)
+			pthread_cond_wait(&pl->ready, &pl->lock);
+		pthread_mutex_unlock(&pl->lock);
+
+		switch (s)
+		{
+		case 1:
+			writecentroids(pl->f, pl->cent);
+			writesizes(pl->f, pl->iingrs);
+			break;
+		case 2:
+			writecompactness(pl->f, pl->compact);
+			break;
+		case 3:
+			writediseases(pl->f, pl->disepro);
+		}
+	}
+	return NULL;
+}
+
+/* 1 - Functions to load the diseases in the background
+   Input:   fname   file with the diseases
+            nelems  number of elements
+            qd      quantized diseases (codes allocated), or NULL
+   Output:  dise    matrix of diseases (nelems x TDISEASE, allocated), complete after pipewaitdise;
+                    with qd, the codes, and pl->dise as returned by readqdise
+***************************************************************************************************/
+void pipeloaddise(struct pipeline *pl, char *fname, int nelems, float **dise, struct qdise *qd)
+{
+	pl->fname = fname;
+	pl->nelems = nelems;
+	pl->dise = dise;
+	pl->qd = qd;
+	pthread_create(&pl->loader, NULL, loaddise, pl);
+}
+
+void pipewaitdise(struct pipeline *pl)
+{
+	pthread_join(pl->loader, NULL);
+}
+
+/* 2 - Functions to write the results in the background
+   Input:   f        results file (already open)
+            cent, iingrs, compact, disepro: results, written when pipestage says they are final
+                     (1: centroids and sizes, 2: compactness, 3: diseases)
+***************************************************************************************************/
+void pipestartwriter(struct pipeline *pl, FILE *f, float cent[][NFEAT], struct gcsr *iingrs, float *compact, struct analysis *disepro)
+{
+	pl->f = f;
+	pl->cent = cent;
+	pl->iingrs = iingrs;
+	pl->compact = compact;
+	pl->disepro = disepro;
+	pl->stage = 0;
+	pthread_mutex_init(&pl->lock, NULL);
+	pthread_cond_init(&pl->ready, NULL);
+	pthread_create(&pl->writer, NULL, writeresults, pl);
+}
+
+void pipestage(struct pipeline *pl, int stage)
+{
+	pthread_mutex_lock(&pl->lock);
+	pl->stage = stage;
+	pthread_cond_signal(&pl->ready);
+	pthread_mutex_unlock(&pl->lock);
+}
+
+void pipeendwriter(struct pipeline *pl)
+{
+	pthread_join(pl->writer, NULL);
+	pthread_mutex_destroy(&pl->lock);
+	pthread_cond_destroy(&pl->ready);
+}
+
+/* 3 - Functions to write each section of the results file
+***************************************************************************************************/
+void writecentroids(FILE *f2, float cent[][NFEAT])
+{
+	fprintf(f2, " Centroids of groups \n\n");
+	for (int i = 0; i < NGROUPS; i++)
+	{
+		for (int j = 0; j < NFEAT; j++)
+			fprintf(f2, "%7.3f", cent[i][j]);
+		fprintf(f2, "\n");
+	}
+}
+
+void writesizes(FILE *f2, struct gcsr *iingrs)
+{
+	fprintf(f2, "\n >> Size of the groups \n\n");
+	for (int i = 0; i < NGROUPS / 10; i++)
+	{
+		for (int j = 0; j < 10; j++)
+			fprintf(f2, "%6d", iingrs->size[10 * i + j]);
+		fprintf(f2, "\n");
+	}
+}
+
+void writecompactness(FILE *f2, float *compact)
+{
+	fprintf(f2, "\n >> Group compactness \n\n");
+	for (int i = 0; i < NGROUPS / 10; i++)
+	{
+		for (int j = 0; j < 10; j++)
+			fprintf(f2, "%9.2f", compact[10 * i + j]);
+		fprintf(f2, "\n");
+	}
+}
+
+void writediseases(FILE *f2, struct analysis *disepro)
+{
+	fprintf(f2, "\n\n Analysis of deseases (medians)\n\n");
+	fprintf(f2, "\n Dise.  M_max - Group   M_min - Group");
+	fprintf(f2, "\n ==================================\n");
+	for (int i = 0; i < TDISEASE; i++)
+		fprintf(f2, "  %2d     %4.2f - %2d      %4.2f - %2d\n", i, disepro[i].mmax,
+				disepro[i].gmax, disepro[i].mmin, disepro[i].gmin);
+}
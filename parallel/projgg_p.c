@@ -0,0 +1,228 @@
+/*
+CA - OpenMP
+projgg_p.c
+Projection pre-pass for Phase 1 used in gengroups_p.c program (option -j)
+
+The features are very redundant (the first centroids even repeat the first NFEAT/2 features in
+the second half), so a few directions keep almost all the variance. Before Phase 1 the elements
+are projected on the first r principal components (covariance in one parallel pass, eigenvectors
+with Jacobi rotations, NFEAT x NFEAT is small). The rows of the projection are orthonormal, so the
+distance in the projected space is a lower bound of the distance in NFEAT dimensions. In each
+iteration the element gets its bound to every centroid (r values each instead of NFEAT), the
+exact distance of the centroid with the lowest bound, and then the exact distance only of the
+centroids whose bound is not above the best distance found. The groups are the ones of
+nearestcentroid, the first centroid if there is a tie (the bounds have a small margin for the
+rounding of the distances).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define PJMARGIN 1e-6	//relative margin of the bounds (the distances use float differences)
+
+// Eigenvectors of the symmetric matrix a (destroyed): columns of v, eigenvalues in the diagonal of a
+static void jacobi(double a[][NFEAT], double v[][NFEAT])
+{
+	int p, q, k;
+
+	for (p = 0; p < NFEAT; p++)
+		for (q = 0; q < NFEAT; q++)
+			v[p][q] = (p == q);
+
+	for (int sweep = 0; sweep < 100; sweep++)
+	{
+		double off = 0.0, diag = 0.0;
+
+		for (p = 0; p < NFEAT; p++)
+		{
+			diag += a[p][p] * a[p][p];
+			for (q = p + 1; q < NFEAT; q++)
+				off += a[p][q] * a[p][q];
+		}
+		if (off <= 1e-24 * diag)
+			break;
+
+		for (p = 0; p < NFEAT; p++)
+			for (q = p + 1; q < NFEAT; q++)
+			{
+				double theta, t, c, s, x, y;
+
+				if (a[p][q] == 0.0)
+					continue;
+				theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+				t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				c = 1.0 / sqrt(t * t + 1.0);
+				s = t * c;
+				for (k = 0; k < NFEAT; k++)
+				{
+					x = a[k][p];
+					y = a[k][q];
+					a[k][p] = c * x - s * y;
+					a[k][q] = s * x + c * y;
+				}
+				for (k = 0; k < NFEAT; k++)
+				{
+					x = a[p][k];
+					y = a[q][k];
+					a[p][k] = c * x - s * y;
+					a[q][k] = s * x + c * y;
+				}
+				for (k = 0; k < NFEAT; k++)
+				{
+					x = v[k][p];
+					y = v[k][q];
+					v[k][p] = c * x - s * y;
+					v[k][q] = s * x + c * y;
+				}
+			}
+	}
+}
+
+/* 1 - Function to build the projection and to project the elements
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            r       dimensions of the projection (1 .. NFEAT)
+            ar      arena for the projected elements (kept until the end of the run)
+   Output:  pj      projection (first r principal components), projected elements and share of
+                    the variance they keep
+***************************************************************************************************/
+void projbuild(int nelems, float **elems, int r, struct projection *pj, struct arena *ar)
+{
+	int nblocks = (nelems + DETBLOCK - 1) / DETBLOCK, b, j, k;
+	size_t mark = arenamark(ar);
+	double (*bcov)[NFEAT][NFEAT + 1] = arenaalloc(ar, nblocks * sizeof(*bcov)); // per block: x x^T, and sums in column NFEAT
+	double cov[NFEAT][NFEAT], v[NFEAT][NFEAT], total = 0.0, kept = 0.0;
+	int order[NFEAT], aux;
+	double *y;
+
+	pj->r = r;
+
+	// [*] sums and products of each block, added in block order
+	#pragma omp parallel for default(none) shared(nelems, elems, nblocks, bcov) private(j, k) schedule(static)
+	for (b = 0; b < nblocks; b++)
+	{
+		memset(bcov[b], 0, sizeof(bcov[b]));
+		for (int i = b * DETBLOCK; (i < nelems) && (i < (b + 1) * DETBLOCK); i++)
+			for (j = 0; j < NFEAT; j++)
+			{
+				bcov[b][j][NFEAT] += elems[i][j];
+				for (k = 0; k <= j; k++)
+					bcov[b][j][k] += (double)elems[i][j] * elems[i][k];
+			}
+	}
+	memset(pj->mean, 0, sizeof(pj->mean));
+	memset(cov, 0, sizeof(cov));
+	for (b = 0; b < nblocks; b++)
+		for (j = 0; j < NFEAT; j++)
+		{
+			pj->mean[j] += bcov[b][j][NFEAT];
+			for (k = 0; k <= j; k++)
+				cov[j][k] += bcov[b][j][k];
+		}
+	arenarelease(ar, mark);
+	for (j = 0; j < NFEAT; j++)
+		pj->mean[j] /= nelems;
+	for (j = 0; j < NFEAT; j++)
+		for (k = 0; k <= j; k++)
+			cov[k][j] = cov[j][k] = cov[j][k] / nelems - pj->mean[j] * pj->mean[k];
+
+	jacobi(cov, v);
+
+	// components by decreasing variance
+	for (j = 0; j < NFEAT; j++)
+	{
+		order[j] = j;
+		total += cov[j][j];
+	}
+	for (j = 0; j < NFEAT; j++)
+		for (k = j + 1; k < NFEAT; k++)
+			if (cov[order[k]][order[k]] > cov[order[j]][order[j]])
+			{
+				aux = order[j];
+				order[j] = order[k];
+				order[k] = aux;
+			}
+	for (j = 0; j < r; j++)
+	{
+		for (k = 0; k < NFEAT; k++)
+			pj->p[j][k] = v[k][order[j]];
+		kept += cov[order[j]][order[j]];
+	}
+	pj->kept = (total > 0.0) ? kept / total : 1.0;
+
+	// [*] projected elements
+	y = pj->y = (double *)arenaalloc(ar, (size_t)nelems * r * sizeof(double));
+	#pragma omp parallel for default(none) shared(nelems, elems, r, pj, y) private(j, k) schedule(static)
+	for (int i = 0; i < nelems; i++)
+		for (j = 0; j < r; j++)
+		{
+			double s = 0.0;
+			for (k = 0; k < NFEAT; k++)
+				s += pj->p[j][k] * (elems[i][k] - pj->mean[k]);
+			y[(size_t)i * r + j] = s;
+		}
+}
+
+/* 2 - Function to project the centroids
+   Input:   g0, g1  range of groups to project [g0, g1)
+   Output:  pcent   projected centroids (NGROUPS x r)
+***************************************************************************************************/
+void projcent(struct projection *pj, float cent[][NFEAT], double *pcent, int g0, int g1)
+{
+	for (int g = g0; g < g1; g++)
+		for (int j = 0; j < pj->r; j++)
+		{
+			double s = 0.0;
+			for (int k = 0; k < NFEAT; k++)
+				s += pj->p[j][k] * (cent[g][k] - pj->mean[k]);
+			pcent[g * pj->r + j] = s;
+		}
+}
+
+/* 3 - Function to get the closest centroid of element i with the bounds of the projection
+   Input:   i, elem element and its index (for its projection)
+            cent, pcent: centroids and projected centroids
+   Output:  as nearestcentroid; nexact gets the exact distances calculated
+***************************************************************************************************/
+int projnearest(struct projection *pj, int i, float *elem, float cent[][NFEAT], double *pcent, double *min_d, long *nexact)
+{
+	double lb[NGROUPS], *y = pj->y + (size_t)i * pj->r, d, t;
+	int r = pj->r, best = 0, g;
+
+	// bound of every centroid, and exact distance of the one with the lowest bound
+	for (g = 0; g < NGROUPS; g++)
+	{
+		double *pc = pcent + g * r;
+		d = 0.0;
+		for (int j = 0; j < r; j++)
+		{
+			t = y[j] - pc[j];
+			d += t * t;
+		}
+		lb[g] = sqrt(d);
+		if (lb[g] < lb[best])
+			best = g;
+	}
+	*min_d = geneticdistance(elem, cent[best]);
+	(*nexact)++;
+
+	// the others only if they can be nearer (or as near, with a lower index)
+	for (g = 0; g < NGROUPS; g++)
+		if ((g != best) && (lb[g] <= *min_d * (1.0 + PJMARGIN)))
+		{
+			d = geneticdistance(elem, cent[g]);
+			(*nexact)++;
+			if ((d < *min_d) || ((d == *min_d) && (g < best)))
+			{
+				*min_d = d;
+				best = g;
+			}
+		}
+	return best;
+}
@@ -0,0 +1,104 @@
+/*
+CA - OpenMP
+quantgg_p.c
+Quantized diseases used in gengroups_p.c program (option -q)
+
+The diseases are probabilities, so each value is kept in one byte: code = round(value x 255),
+4 times less memory than float32. The median of a group is a value of the group (not an
+average), and the codes are in the same order as the values, so the median of the codes is the
+code of the median. It is exact as long as no two different values get the same code: the value
+of every code is kept in a codebook and checked against every value read. If a value is not in
+[0, 1] or shares its code with another value, the diseases are read again as float32.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+// float32 matrix of diseases, one block (only when the codes are not exact)
+static float **readfloat(FILE *f1, int nelems)
+{
+	float **dise = (float **)malloc(nelems * sizeof(float *));
+
+	dise[0] = (float *)malloc((size_t)nelems * TDISEASE * sizeof(float));
+	for (int i = 0; i < nelems; i++)
+	{
+		dise[i] = dise[0] + (size_t)i * TDISEASE;
+		for (int j = 0; j < TDISEASE; j++)
+			fscanf(f1, "%f", &dise[i][j]);
+	}
+	return dise;
+}
+
+/* 1 - Function to read the diseases and quantize them
+   Input:   fname   file with the diseases
+            nelems  number of elements
+   Output:  qd      codes and codebook (qd->code must have space for nelems x TDISEASE codes);
+                    qd->exact is 0 if the codes do not keep the values
+            returns NULL if the codes are exact, otherwise the diseases read as float32
+***************************************************************************************************/
+float **readqdise(char *fname, int nelems, struct qdise *qd)
+{
+	FILE *f1;
+	float v;
+	long c;
+	int i, j;
+
+	f1 = zopen(fname);
+	if (f1 == NULL)
+	{
+		printf("Error opening file %s \n", fname);
+		exit(-1);
+	}
+
+	memset(qd->used, 0, sizeof(qd->used));
+	qd->exact = 1;
+	for (i = 0; (i < nelems) && qd->exact; i++)
+		for (j = 0; j < TDISEASE; j++)
+		{
+			fscanf(f1, "%f", &v);
+			c = ((v >= 0.0f) && (v <= 1.0f)) ? lroundf(v * (QLEVELS - 1)) : -1;
+			if ((c < 0) || (qd->used[j][c] && (qd->book[j][c] != v)))
+			{
+				qd->exact = 0;
+				break;
+			}
+			qd->used[j][c] = 1;
+			qd->book[j][c] = v;
+			qd->code[(size_t)i * TDISEASE + j] = (unsigned char)c;
+		}
+
+	if (qd->exact)
+	{
+		fclose(f1);
+		return NULL;
+	}
+
+	printf("\n    Diseases can not be quantized exactly, float32 is used\n");
+	fclose(f1);
+	f1 = zopen(fname); // compressed files can not be rewound
+	float **dise = readfloat(f1, nelems);
+	fclose(f1);
+	return dise;
+}
+
+/* 2 - Function to get the median of the codes of one disease in one group
+   Input:   codes   codes of the members of the group (vector of size gsize)
+            book    value of each code of the disease
+   Output:  value in position gsize / 2 of the sorted list, as groupmedian
+   [*] counting of the codes: O(gsize + QLEVELS), no reordering
+***************************************************************************************************/
+float qmedian(unsigned char *codes, int gsize, float *book)
+{
+	int count[QLEVELS] = {0};
+	int c, pos = 0;
+
+	for (int k = 0; k < gsize; k++)
+		count[codes[k]]++;
+	for (c = 0; pos + count[c] <= gsize / 2; c++)
+		pos += count[c];
+	return book[c];
+}
@@ -0,0 +1,163 @@
+/*
+CA - OpenMP
+silgg_p.c
+Silhouette and distance to the centroid of every element used in gengroups_p.c program (option -o)
+
+The silhouette of element i in group g is s = (b - a) / max(a, b), with a the average distance
+to the other members of g and b the lowest average distance to the members of another group
+(0 for the elements alone in their group). It needs the distance of i to every element:
+  - the rows are copied in group order (as the members of the groups) to one buffer
+  - the elements to evaluate are taken in blocks of SILTARGET, and the rows in blocks of
+    SILSOURCE (they stay in cache while the whole block of targets uses them); each target adds
+    its distances to one sum per group
+  - [*] the blocks of targets are independent (each one has its own sums, in the scratch sub-arena
+    of its thread, smaller than what lloyd takes from it), dynamic schedule
+All the elements (O(n^2) distances), or nsample elements evenly spaced in group order (so every
+group in proportion to its size): their silhouette is exact, only the mean is estimated.
+The group, the distance to the centroid and the silhouette of every element (NaN if it was not
+evaluated) are written to a binary file, one column after the other.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define SILTARGET 32	//elements evaluated together
+#define SILSOURCE 1024	//rows of each block of the other elements (160 KB with NFEAT 40)
+#define SILMAGIC  "GGELEM01"
+
+/* 1 - Function to calculate the silhouette of all the elements or of a sample
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            iingrs  size and members of each group
+            nsample elements to evaluate, evenly spaced (0 or nelems or more: all)
+            ar      arena for the rows in group order
+            scratch scratch sub-arena of each thread, for the sums of the blocks
+   Output:  sil     silhouette of each element (NaN if not evaluated)
+            returns the average silhouette of the evaluated elements
+***************************************************************************************************/
+double silhouette(int nelems, float **elems, struct gcsr *iingrs, int nsample, float *sil, struct arena *ar, struct arena *scratch)
+{
+	size_t mark = arenamark(ar);
+	float *rows = (float *)arenaalloc(ar, (size_t)nelems * NFEAT * sizeof(float));
+	gindex *rgrp = (gindex *)arenaalloc(ar, nelems * sizeof(gindex));
+	int *target, ntarget, g;
+	double total = 0.0;
+
+	if ((nsample <= 0) || (nsample > nelems))
+		nsample = nelems;
+	ntarget = nsample;
+	target = (int *)arenaalloc(ar, ntarget * sizeof(int));
+
+	// rows in group order, and the positions to evaluate (all, or nsample evenly spaced)
+	#pragma omp parallel default(none) shared(nelems, elems, iingrs, rows, rgrp, sil, nsample, target, ntarget) private(g)
+	{
+		#pragma omp for schedule(dynamic)
+		for (g = 0; g < NGROUPS; g++)
+			for (int k = iingrs->first[g]; k < iingrs->first[g + 1]; k++)
+			{
+				memcpy(rows + (size_t)k * NFEAT, elems[iingrs->members[k]], NFEAT * sizeof(float));
+				rgrp[k] = g;
+			}
+		#pragma omp for nowait
+		for (int i = 0; i < nelems; i++)
+			sil[i] = NAN;
+		#pragma omp for
+		for (int t = 0; t < ntarget; t++)
+			target[t] = (int)((double)t * nelems / nsample);
+	}
+
+	// [*] blocks of targets against blocks of rows; each block of targets has its own sums
+	#pragma omp parallel default(none) shared(nelems, iingrs, rows, rgrp, sil, target, ntarget, scratch) private(g) reduction(+:total)
+	{
+		int tid = omp_get_thread_num();
+		size_t smark = arenamark(&scratch[tid]);
+		double (*sums)[NGROUPS] = arenaalloc(&scratch[tid], SILTARGET * sizeof(*sums));
+
+		#pragma omp for schedule(dynamic)
+		for (int tb = 0; tb < ntarget; tb += SILTARGET)
+		{
+			int nt = (ntarget - tb < SILTARGET) ? ntarget - tb : SILTARGET;
+
+			memset(sums, 0, SILTARGET * sizeof(*sums));
+			for (int sb = 0; sb < nelems; sb += SILSOURCE)
+			{
+				int last = (nelems - sb < SILSOURCE) ? nelems : sb + SILSOURCE;
+
+				for (int t = 0; t < nt; t++)
+				{
+					float *x = rows + (size_t)target[tb + t] * NFEAT;
+					for (int k = sb; k < last; k++)
+						sums[t][rgrp[k]] += geneticdistance(x, rows + (size_t)k * NFEAT);
+				}
+			}
+
+			for (int t = 0; t < nt; t++)
+			{
+				int k = target[tb + t], own = rgrp[k];
+				double a, b = -1.0, s = 0.0;
+
+				if (iingrs->size[own] > 1)
+				{
+					a = sums[t][own] / (iingrs->size[own] - 1); // the distance to itself is 0
+					for (g = 0; g < NGROUPS; g++)
+						if ((g != own) && (iingrs->size[g] > 0) && ((b < 0.0) || (sums[t][g] / iingrs->size[g] < b)))
+							b = sums[t][g] / iingrs->size[g];
+					if ((b >= 0.0) && ((a > 0.0) || (b > 0.0)))
+						s = (b - a) / ((a > b) ? a : b);
+				}
+				sil[iingrs->members[k]] = s;
+				total += s;
+			}
+		}
+
+		arenarelease(&scratch[tid], smark);
+	}
+
+	arenarelease(ar, mark);
+	return total / ntarget;
+}
+
+/* 2 - Function to calculate the distance of every element to the centroid of its group
+   Output:  dist    distance of each element
+***************************************************************************************************/
+void centroiddist(int nelems, float **elems, float cent[][NFEAT], gindex *grind, float *dist)
+{
+	#pragma omp parallel for default(none) shared(nelems, elems, cent, grind, dist)
+	for (int i = 0; i < nelems; i++)
+		dist[i] = geneticdistance(elems[i], cent[grind[i]]);
+}
+
+/* 3 - Function to write the file of the elements: header (magic, number of elements, NGROUPS), then
+   the group (unsigned 16 bits), the distance to the centroid and the silhouette (float32) of every
+   element, one column after the other
+***************************************************************************************************/
+void writeelements(char *fname, int nelems, gindex *grind, float *dist, float *sil)
+{
+	int head[2] = {nelems, NGROUPS};
+	unsigned short buf[4096];
+	FILE *f = fopen(fname, "wb");
+
+	if (f == NULL)
+	{
+		printf("Error when opening file %s \n", fname);
+		return;
+	}
+	fwrite(SILMAGIC, 1, 8, f);
+	fwrite(head, sizeof(int), 2, f);
+	for (int i = 0; i < nelems; i += 4096)
+	{
+		int n = (nelems - i < 4096) ? nelems - i : 4096;
+		for (int k = 0; k < n; k++)
+			buf[k] = grind[i + k];
+		fwrite(buf, sizeof(unsigned short), n, f);
+	}
+	fwrite(dist, sizeof(float), nelems, f);
+	fwrite(sil, sizeof(float), nelems, f);
+	fclose(f);
+}
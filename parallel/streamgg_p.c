@@ -0,0 +1,425 @@
+/*
+CA - OpenMP
+streamgg_p.c
+Out-of-core (streaming) routines used in gengroups_p.c program (option -s)
+
+Elements and diseases are kept in binary files of float32 rows instead of memory.
+Every Lloyd iteration is one sequential pass over the elements file, read in chunks
+with a double buffer: a reader thread loads the next chunk (pread) while the OpenMP
+team classifies the current one. Phase 2 buckets the rows by group on disk, so only
+one group at a time has to be resident: one file for the elements and one for the diseases, with
+the rows of every group together (the first row of each group is in iingrs->first), so any
+number of groups needs only two open files.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+struct chunkread           // work of the reader thread
+{
+ struct stream *st;
+ int            b;         // buffer to fill
+ int            first, n;  // first row and number of rows to read
+};
+
+// Read n rows starting at row first into buffer b (pread may return less bytes than asked)
+static void *readchunk(void *arg)
+{
+	struct chunkread *cr = (struct chunkread *)arg;
+	size_t rowbytes = (size_t)cr->st->ncols * sizeof(float);
+	size_t total = (size_t)cr->n * rowbytes, done = 0;
+	off_t offset = (off_t)cr->first * rowbytes;
+	ssize_t r;
+
+	while (done < total)
+	{
+		r = pread(cr->st->fd, (char *)cr->st->buf[cr->b] + done, total - done, offset + done);
+		if (r <= 0)
+		{
+			printf("Error reading the binary file (row %d) \n", cr->first);
+			exit(-1);
+		}
+		done += r;
+	}
+	return NULL;
+}
+
+// Read the n rows of ncols floats of one group, from row first of a bucket file
+static float *readbucket(char *name, int first, int n, int ncols)
+{
+	FILE *f;
+	float *data = (float *)malloc((size_t)n * ncols * sizeof(float) + 1);
+
+	f = fopen(name, "rb");
+	if ((f == NULL) || (fseeko(f, (off_t)first * ncols * sizeof(float), SEEK_SET) != 0) ||
+		(fread(data, sizeof(float) * ncols, n, f) != (size_t)n))
+	{
+		printf("Error reading bucket file %s \n", name);
+		exit(-1);
+	}
+	fclose(f);
+	return data;
+}
+
+// Write n rows of ncols floats at row first of a bucket file (pwrite may write less bytes than asked)
+static void writebucket(int fd, float *rows, int first, int n, int ncols)
+{
+	size_t total = (size_t)n * ncols * sizeof(float), done = 0;
+	off_t offset = (off_t)first * ncols * sizeof(float);
+	ssize_t r;
+
+	while (done < total)
+	{
+		r = pwrite(fd, (char *)rows + done, total - done, offset + done);
+		if (r <= 0)
+		{
+			printf("Error writing the bucket files \n");
+			exit(-1);
+		}
+		done += r;
+	}
+}
+
+/* 1 - Function to convert a text file of the input format to a binary file of float32 rows
+   Input:   fname    text file
+            nelems   number of rows to convert
+            ncols    values per row
+            header   1 if the file starts with the number of elements
+   Output:  binname  binary file, nelems x ncols floats
+***************************************************************************************************/
+int streamconvert(char *fname, int nelems, int ncols, int header, char *binname)
+{
+	FILE *f1, *f2;
+	float row[ncols];
+	int i, j, aux;
+
+	f1 = zopen(fname);
+	if (f1 == NULL)
+	{
+		printf("Error opening file %s \n", fname);
+		exit(-1);
+	}
+	f2 = fopen(binname, "wb");
+	if (f2 == NULL)
+	{
+		printf("Error creating file %s \n", binname);
+		exit(-1);
+	}
+
+	if (header)
+		fscanf(f1, "%d", &aux);
+
+	// one sequential pass, only one row in memory
+	for (i = 0; i < nelems; i++)
+	{
+		for (j = 0; j < ncols; j++)
+			if (fscanf(f1, "%f", &row[j]) != 1)
+			{
+				printf("Error: file %s has only %d rows \n", fname, i);
+				exit(-1);
+			}
+		fwrite(row, sizeof(float), ncols, f2);
+	}
+
+	fclose(f1);
+	fclose(f2);
+	return nelems;
+}
+
+/* 2 - Functions to open / close a binary file of rows for streaming
+   Input:   binname  binary file
+            ncols    floats per row
+            nrows    rows to use
+            chunk    rows per chunk
+   Output:  st       stream, with the double buffer allocated
+***************************************************************************************************/
+void streamopen(struct stream *st, char *binname, int ncols, int nrows, int chunk)
+{
+	struct stat sb;
+	int b, i;
+
+	st->fd = open(binname, O_RDONLY);
+	if ((st->fd < 0) || (fstat(st->fd, &sb) != 0))
+	{
+		printf("Error opening file %s \n", binname);
+		exit(-1);
+	}
+	// a short file would be read as garbage (pread stops at its end, in the middle of a chunk)
+	if ((size_t)sb.st_size < (size_t)nrows * ncols * sizeof(float))
+	{
+		printf("Error: file %s has %lld rows of %d values, %d are needed \n", binname,
+			   (long long)(sb.st_size / (ncols * sizeof(float))), ncols, nrows);
+		exit(-1);
+	}
+	st->ncols = ncols;
+	st->nrows = nrows;
+	st->chunk = chunk;
+
+	for (b = 0; b < 2; b++)
+	{
+		st->buf[b] = (float *)malloc((size_t)chunk * ncols * sizeof(float));
+		st->rows[b] = (float **)malloc(chunk * sizeof(float *));
+		for (i = 0; i < chunk; i++)
+			st->rows[b][i] = st->buf[b] + (size_t)i * ncols;
+	}
+
+	// we are going to read the file sequentially, many times
+	posix_fadvise(st->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+void streamclose(struct stream *st)
+{
+	close(st->fd);
+	for (int b = 0; b < 2; b++)
+	{
+		free(st->buf[b]);
+		free(st->rows[b]);
+	}
+}
+
+/* 3 - Function to calculate the closest group of each element and the additions for the new centroids,
+       in one sequential pass over the elements file
+   Input:   st        stream of the elements
+            cent      centroids (NGROUPS x NFEAT)
+   Output:  grind     closest group of each element (vector of size st->nrows)
+            additions values of each feature accumulated per group, last value: number of elements
+***************************************************************************************************/
+void streamclosestgroup(struct stream *st, float cent[][NFEAT], gindex *grind, double additions[][NFEAT + 1])
+{
+	struct chunkread cr[2];
+	pthread_t reader;
+	int c, nchunks, b, first, n, i, j;
+
+	for (i = 0; i < NGROUPS; i++)
+		for (j = 0; j < NFEAT + 1; j++)
+			additions[i][j] = 0.0;
+
+	nchunks = (st->nrows + st->chunk - 1) / st->chunk;
+
+	// the first chunk has nothing to overlap with
+	cr[0].st = st; cr[0].b = 0; cr[0].first = 0;
+	cr[0].n = (st->nrows < st->chunk) ? st->nrows : st->chunk;
+	readchunk(&cr[0]);
+
+	for (c = 0; c < nchunks; c++)
+	{
+		b = c % 2;
+		first = c * st->chunk;
+		n = cr[b].n;
+
+		// [*] start reading the next chunk in the other buffer; it overlaps with the classification of this one
+		if (c + 1 < nchunks)
+		{
+			cr[1 - b].st = st;
+			cr[1 - b].b = 1 - b;
+			cr[1 - b].first = first + st->chunk;
+			cr[1 - b].n = (st->nrows - cr[1 - b].first < st->chunk) ? st->nrows - cr[1 - b].first : st->chunk;
+			pthread_create(&reader, NULL, readchunk, &cr[1 - b]);
+		}
+
+		#pragma omp parallel default(none) shared(st, b, n, first, cent, grind, additions) private(i, j)
+		{
+			double min_d;
+
+			// same loop as closestgroup, for the narrow group type
+			#pragma omp for nowait
+			for (i = 0; i < n; i++)
+				grind[first + i] = nearestcentroid(st->rows[b][i], cent, NGROUPS, &min_d);
+
+			// [*] the classification has nowait, but every element must be classified before accumulating
+			#pragma omp barrier
+
+			// [*] same reduction as the in-memory version, additions keeps the values of previous chunks
+			#pragma omp for reduction(+:additions[:NGROUPS])
+			for (i = 0; i < n; i++)
+			{
+				for (j = 0; j < NFEAT; j++)
+					additions[grind[first + i]][j] += st->rows[b][i][j];
+				additions[grind[first + i]][NFEAT]++;
+			}
+		}
+
+		if (c + 1 < nchunks)
+			pthread_join(reader, NULL);
+	}
+}
+
+/* 4 - Function to distribute elements and diseases by group in two bucket files, in one pass
+   Input:   ste, std  streams of elements and diseases
+            grind     group of each element
+            dir       directory for the bucket files
+   Output:  iingrs    size and first row of each group in the bucket files (members are not stored)
+***************************************************************************************************/
+void streambucket(struct stream *ste, struct stream *std, gindex *grind, struct gcsr *iingrs, char *dir)
+{
+	int *pos = (int *)malloc(NGROUPS * sizeof(int));       // next row of each group in the files
+	int *cnt = (int *)malloc((NGROUPS + 1) * sizeof(int)); // rows of each group in the chunk
+	float *se = (float *)malloc((size_t)ste->chunk * NFEAT * sizeof(float));    // chunk, in group order
+	float *sd = (float *)malloc((size_t)ste->chunk * TDISEASE * sizeof(float));
+	char name[4096];
+	struct chunkread cr;
+	int fe, fd, first, i, g, k;
+
+	// sizes of the groups from grind (in memory): each group has its place in the files
+	memset(iingrs->size, 0, sizeof(iingrs->size));
+	for (i = 0; i < ste->nrows; i++)
+		iingrs->size[grind[i]]++;
+	iingrs->first[0] = 0;
+	for (g = 0; g < NGROUPS; g++)
+	{
+		iingrs->first[g + 1] = iingrs->first[g] + iingrs->size[g];
+		pos[g] = iingrs->first[g];
+	}
+
+	snprintf(name, sizeof(name), "%s/buckets_e.bin", dir);
+	fe = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	snprintf(name, sizeof(name), "%s/buckets_d.bin", dir);
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if ((fe < 0) || (fd < 0))
+	{
+		printf("Error creating bucket files in %s \n", dir);
+		exit(-1);
+	}
+
+	for (first = 0; first < ste->nrows; first += ste->chunk)
+	{
+		cr.first = first;
+		cr.n = (ste->nrows - first < ste->chunk) ? ste->nrows - first : ste->chunk;
+		cr.b = 0;
+		cr.st = ste;
+		readchunk(&cr);
+		cr.st = std;
+		readchunk(&cr);
+
+		// rows of the chunk in group order (counting sort), then one write per group of the chunk
+		memset(cnt, 0, (NGROUPS + 1) * sizeof(int));
+		for (i = 0; i < cr.n; i++)
+			cnt[grind[first + i] + 1]++;
+		for (g = 0; g < NGROUPS; g++)
+			cnt[g + 1] += cnt[g];
+		for (i = 0; i < cr.n; i++)
+		{
+			k = cnt[grind[first + i]]++;
+			memcpy(se + (size_t)k * NFEAT, ste->rows[0][i], NFEAT * sizeof(float));
+			memcpy(sd + (size_t)k * TDISEASE, std->rows[0][i], TDISEASE * sizeof(float));
+		}
+		// cnt[g] is now the end of group g in the chunk
+		for (g = 0, k = 0; g < NGROUPS; k = cnt[g++])
+			if (cnt[g] > k)
+			{
+				writebucket(fe, se + (size_t)k * NFEAT, pos[g], cnt[g] - k, NFEAT);
+				writebucket(fd, sd + (size_t)k * TDISEASE, pos[g], cnt[g] - k, TDISEASE);
+				pos[g] += cnt[g] - k;
+			}
+	}
+
+	close(fe);
+	close(fd);
+	free(pos);
+	free(cnt);
+	free(se);
+	free(sd);
+}
+
+/* 5 - Function to calculate the compactness of each group from its bucket file
+   Input:  iingrs   size of each group
+           dir      directory of the bucket files
+   Output: compact  compactness of each group (vector of size NGROUPS, by reference)
+***************************************************************************************************/
+void streamcompactness(struct gcsr *iingrs, char *dir, float *compact)
+{
+	char name[4096];
+	float *data;
+	double *tsum, comp_aux;
+	int *tfirst, ntiles, gsize;
+
+	// one group at a time in memory (the groups of this mode can be too big for two of them); its
+	// triangle of pairs is split in tiles as in memory (see pairtiles in taskgg_p.c)
+	snprintf(name, sizeof(name), "%s/buckets_e.bin", dir);
+	for (int i = 0; i < NGROUPS; i++)
+	{
+		gsize = iingrs->size[i];
+		data = readbucket(name, iingrs->first[i], gsize, NFEAT);
+
+		if (gsize <= 1)
+			compact[i] = 0.0;
+		else
+		{
+			tfirst = (int *)malloc((gsize + 1) * sizeof(int));
+			ntiles = pairtiles(gsize, tfirst);
+			tsum = (double *)malloc(ntiles * sizeof(double));
+
+			// [*] dynamic schedule: the tiles have about the same pairs, but not exactly
+			#pragma omp parallel for default(none) shared(data, gsize, tfirst, tsum, ntiles) schedule(dynamic)
+			for (int t = 0; t < ntiles; t++)
+			{
+				double sum = 0.0;
+				for (int j = tfirst[t]; j < tfirst[t + 1]; j++)
+					for (int k = j + 1; k < gsize; k++)
+						sum += geneticdistance(data + (size_t)j * NFEAT, data + (size_t)k * NFEAT);
+				tsum[t] = sum;
+			}
+
+			// tiles added in order
+			comp_aux = 0.0;
+			for (int t = 0; t < ntiles; t++)
+				comp_aux += tsum[t];
+			compact[i] = (float)(comp_aux / ((double)gsize * (gsize - 1) / 2));
+			free(tfirst);
+			free(tsum);
+		}
+		free(data);
+	}
+	unlink(name);
+}
+
+/* 6 - Function to analyse diseases from the bucket files
+   Input:  iingrs   size of each group
+           dir      directory of the bucket files
+   Output: disepro  analysis of the diseases: maximum, minimum of the medians and groups
+***************************************************************************************************/
+void streamdiseases(struct gcsr *iingrs, char *dir, struct analysis *disepro)
+{
+	char name[4096];
+	float *data, *diseaseList;
+	int gsize;
+
+	for (int i = 0; i < TDISEASE; i++)
+	{
+		disepro[i].mmax = FLT_MIN;
+		disepro[i].mmin = FLT_MAX;
+	}
+
+	snprintf(name, sizeof(name), "%s/buckets_d.bin", dir);
+	#pragma omp parallel for default(none) shared(iingrs, name, disepro) private(data, diseaseList, gsize) schedule(dynamic)
+	for (int i = 0; i < NGROUPS; i++)
+	{
+		gsize = iingrs->size[i];
+		data = readbucket(name, iingrs->first[i], gsize, TDISEASE);
+
+		if (gsize > 0)
+		{
+			diseaseList = (float *)malloc(gsize * sizeof(float));
+			for (int j = 0; j < TDISEASE; j++)
+			{
+				for (int k = 0; k < gsize; k++)
+					diseaseList[k] = data[(size_t)k * TDISEASE + j];
+
+				updatedisepro(disepro, j, i, groupmedian(diseaseList, gsize));
+			}
+			free(diseaseList);
+		}
+		free(data);
+	}
+	unlink(name);
+}
@@ -0,0 +1,207 @@
+/*
+CA - OpenMP
+sweepgg_p.c
+Sweep of the number of groups used in gengroups_p.c program (option -k)
+
+Clusters the same elements for K = kmin, kmin + kstep, ... kmax (kmax <= NGROUPS) in one
+process, to draw elbow plots without recompiling definegg.h. The squared norm of every element
+is computed once and shared by all the K values: |x - c|^2 = |x|^2 - 2 x.c + |c|^2 (in double:
+the subtraction cancels when x and c are close). When the two nearest centroids are nearer than
+the rounding of both ways to get the distance, they are compared again with geneticdistance, so
+the element gets the group that nearestcentroid would give it.
+Each K starts from the solution of the previous one, adding the new centroids at the elements
+farthest from their centroid (farthest-first), so it usually needs a few iterations only.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+#define SWEEPTIE 1e-6	//gap of the two nearest centroids, relative to |x|^2 + |c|^2, checked again
+
+// squared distance between an element (with its squared norm) and a centroid (with its squared norm)
+static inline double normdistance(float *elem, double enorm, float *cent, double cnorm)
+{
+	double dot = 0.0, d2;
+
+	for (int j = 0; j < NFEAT; j++)
+		dot += (double)elem[j] * cent[j];
+	d2 = enorm - 2.0 * dot + cnorm;
+	return (d2 > 0.0) ? d2 : 0.0;
+}
+
+/* 1 - Function to cluster the elements for every K of the sweep
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            kmin, kmax, kstep  values of K
+   Output:  res     iterations, inertia and average compactness of each K (one per value of K)
+            iingrs  used as workspace for the compactness (members for nelems elements)
+            ar      arena for the vectors of the sweep
+            returns the number of values of K
+***************************************************************************************************/
+int sweep(int nelems, float **elems, int kmin, int kmax, int kstep, struct sweepk *res, struct gcsr *iingrs, struct arena *ar)
+{
+	float (*cent)[NFEAT], *compact;
+	double (*additions)[NFEAT + 1], *cnorm;
+	double *enorm, *mind;     // squared norm of each element, squared distance to its centroid
+	gindex *grind;
+	int k, kprev = 0, nk = 0, niter, finish, i, j, c, far, ngr;
+	double inertia, farthest, comp;
+
+	size_t mark = arenamark(ar);
+
+	// vectors of the groups, from the arena as those of the elements
+	cent = arenaalloc(ar, NGROUPS * sizeof(*cent));
+	compact = (float *)arenaalloc(ar, NGROUPS * sizeof(float));
+	additions = arenaalloc(ar, NGROUPS * sizeof(*additions));
+	cnorm = (double *)arenaalloc(ar, NGROUPS * sizeof(double));
+	enorm = (double *)arenaalloc(ar, nelems * sizeof(double));
+	mind = (double *)arenaalloc(ar, nelems * sizeof(double));
+	grind = (gindex *)arenaalloc(ar, nelems * sizeof(gindex));
+
+	// [*] the norms are the same for every K and every iteration
+	#pragma omp parallel for default(none) shared(nelems, elems, enorm) private(j)
+	for (i = 0; i < nelems; i++)
+	{
+		enorm[i] = 0.0;
+		for (j = 0; j < NFEAT; j++)
+			enorm[i] += (double)elems[i][j] * elems[i][j];
+	}
+
+	initcentroids(cent, 147);
+
+	for (k = kmin; k <= kmax; k += kstep)
+	{
+		// warm start: keep the previous centroids, and put the new ones in the farthest elements
+		for (c = kprev; (kprev > 0) && (c < k); c++)
+		{
+			farthest = -1.0;
+			far = 0;
+			for (i = 0; i < nelems; i++)
+				if (mind[i] > farthest)
+				{
+					farthest = mind[i];
+					far = i;
+				}
+			for (j = 0; j < NFEAT; j++)
+				cent[c][j] = elems[far][j];
+
+			// the next new centroid must be far from this one too
+			cnorm[c] = enorm[far];
+			#pragma omp parallel for default(none) shared(nelems, elems, enorm, mind, cent, cnorm, c)
+			for (i = 0; i < nelems; i++)
+			{
+				double d2 = normdistance(elems[i], enorm[i], cent[c], cnorm[c]);
+				if (d2 < mind[i])
+					mind[i] = d2;
+			}
+		}
+
+		// Lloyd iterations for k groups
+		niter = 0;
+		finish = 0;
+		while ((finish == 0) && (niter < MAXIT))
+		{
+			for (c = 0; c < k; c++)
+			{
+				cnorm[c] = 0.0;
+				for (j = 0; j < NFEAT; j++)
+					cnorm[c] += (double)cent[c][j] * cent[c][j];
+			}
+			memset(additions, 0, NGROUPS * sizeof(*additions));
+			inertia = 0.0;
+
+			#pragma omp parallel default(none) shared(nelems, elems, enorm, mind, grind, cent, cnorm, k, additions, finish) private(i, j, c) reduction(+:inertia)
+			{
+				// [*] classification and additions in the same pass; only the k first groups are used
+				#pragma omp for reduction(+:additions[:k])
+				for (i = 0; i < nelems; i++)
+				{
+					double d2, min_d2 = DBL_MAX, sec_d2 = DBL_MAX;
+					int g = 0, g2 = -1;
+
+					for (c = 0; c < k; c++)
+					{
+						d2 = normdistance(elems[i], enorm[i], cent[c], cnorm[c]);
+						if (d2 < min_d2)
+						{
+							sec_d2 = min_d2;
+							g2 = g;
+							min_d2 = d2;
+							g = c;
+						}
+						else if (d2 < sec_d2)
+						{
+							sec_d2 = d2;
+							g2 = c;
+						}
+					}
+					// near tie: the two nearest again as nearestcentroid (the first one if they are equal)
+					if ((g2 >= 0) && (sec_d2 - min_d2 <= SWEEPTIE * (enorm[i] + cnorm[g])))
+					{
+						double d = geneticdistance(elems[i], cent[g]), d_2 = geneticdistance(elems[i], cent[g2]);
+
+						if ((d_2 < d) || ((d_2 == d) && (g2 < g)))
+						{
+							g = g2;
+							d = d_2;
+						}
+						min_d2 = d * d;
+					}
+					grind[i] = g;
+					mind[i] = min_d2;
+					inertia += min_d2;
+					for (j = 0; j < NFEAT; j++)
+						additions[g][j] += elems[i][j];
+					additions[g][NFEAT]++;
+				}
+
+				#pragma omp single
+				finish = 1;
+
+				// groups >= k have no elements, so they are not changed
+				newcentroids(additions, cent, NULL, &finish);
+			}
+			niter++;
+		}
+
+		// compactness of the k groups, with the same tasks as Phase 2 (without diseases)
+		groupmembers(nelems, grind, iingrs, ar);
+		analysistasks(elems, NULL, NULL, iingrs, compact, NULL, NULL, ar);
+
+		comp = 0.0;
+		ngr = 0;
+		for (c = 0; c < k; c++)
+			if (iingrs->size[c] > 0)
+			{
+				comp += compact[c];
+				ngr++;
+			}
+
+		res[nk].k = k;
+		res[nk].niter = niter;
+		res[nk].inertia = inertia;
+		res[nk].compact = (ngr > 0) ? comp / ngr : 0.0;
+		nk++;
+		kprev = k;
+	}
+
+	arenarelease(ar, mark);
+	return nk;
+}
+
+/* 2 - Function to write the results of the sweep
+***************************************************************************************************/
+void writesweep(FILE *f2, struct sweepk *res, int nk)
+{
+	fprintf(f2, " Sweep of the number of groups \n\n");
+	fprintf(f2, "\n     K   Iter.          Inertia   Compactness");
+	fprintf(f2, "\n ============================================\n");
+	for (int s = 0; s < nk; s++)
+		fprintf(f2, "  %4d   %5d  %15.2f   %11.2f\n", res[s].k, res[s].niter, res[s].inertia, res[s].compact);
+}
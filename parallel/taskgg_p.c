@@ -0,0 +1,284 @@
+/*
+CA - OpenMP
+taskgg_p.c
+Phase 2 of gengroups_p.c program (in-memory version) as a graph of tasks
+
+The members of each group are found with a parallel counting sort (no critical section, and the
+members are kept in increasing order). Then, for every group, from the largest to the smallest:
+  - gather:      the rows and the diseases (or their codes, see quantgg_p.c) of the members are
+                 copied to a contiguous buffer
+  - compactness: the triangle of pairs is split in tiles of about tilepairs distances (TILEPAIRS,
+                 or the value of the autotuning)
+  - medians:     one selection task per disease
+The buffers are slots of the arena: GROUPSLOTS per thread, each one reused by every
+GROUPSLOTS x threads groups (the gather of a group waits for the tasks of the group that had the
+slot before), so only the groups being analysed are copied, not all of them at once. The thread
+that creates the tasks also waits for the slot before it creates the tasks of its next group:
+otherwise the dependences of each slot pile up the tasks of all the groups created before, and with
+libgomp the graph took 10 s for 2000 groups of 10 elements (0.03 s with the wait).
+Tiles and medians depend on the gather of their group only, so the big groups are split among
+all the threads and the small ones fill the gaps, instead of two dynamic loops with a barrier.
+The tasks of each group have a priority proportional to its size, so the runtime starts the big
+groups first even if it does not follow the order of creation (the priorities are only used up to
+OMP_MAX_TASK_PRIORITY, which is 0 by default: run with, e.g., OMP_MAX_TASK_PRIORITY=100).
+The tiles have a fixed shape (it only depends on the size of the group) and are added in order.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "../shared/fungg.h"
+#include "fungg_p.h"
+
+int tilepairs = TILEPAIRS;  // distances of each compactness tile
+
+// Order of the groups in Phase 2: larger first, and lower index first if they have the same size
+static int largerfirst(const void *a, const void *b)
+{
+	const struct groupsize *x = a, *y = b;
+
+	if (x->size != y->size)
+		return (x->size > y->size) ? -1 : 1;
+	return x->g - y->g;
+}
+
+/* 1 - Function to get the members of each group (parallel counting sort)
+   Input:   nelems  number of elements
+            grind   group of each element
+            ar      arena for the counters
+   Output:  iingrs  size, first position and members of each group, in increasing order
+                    (iingrs->members must have space for nelems members)
+***************************************************************************************************/
+void groupmembers(int nelems, gindex *grind, struct gcsr *iingrs, struct arena *ar)
+{
+	int nthr = omp_get_max_threads();
+	size_t mark = arenamark(ar);
+	int *cnt = (int *)arenaalloc(ar, (size_t)nthr * NGROUPS * sizeof(int)); // elements of each group per thread
+
+	memset(cnt, 0, (size_t)nthr * NGROUPS * sizeof(int));
+
+	#pragma omp parallel default(none) shared(nelems, grind, iingrs, cnt)
+	{
+		int *mycnt = cnt + (size_t)omp_get_thread_num() * NGROUPS;
+		int nt = omp_get_num_threads();
+
+		// [*] static scheduling in both loops: each thread gets the same elements
+		#pragma omp for schedule(static)
+		for (int i = 0; i < nelems; i++)
+			mycnt[grind[i]]++;
+
+		// first position of each group, and of each thread in each group
+		#pragma omp single
+		{
+			int pos = 0, aux;
+			for (int g = 0; g < NGROUPS; g++)
+			{
+				iingrs->first[g] = pos;
+				for (int t = 0; t < nt; t++)
+				{
+					aux = cnt[t * NGROUPS + g];
+					cnt[t * NGROUPS + g] = pos;
+					pos += aux;
+				}
+				iingrs->size[g] = pos - iingrs->first[g];
+			}
+			iingrs->first[NGROUPS] = pos;
+		}
+
+		#pragma omp for schedule(static)
+		for (int i = 0; i < nelems; i++)
+			iingrs->members[mycnt[grind[i]]++] = i;
+	}
+
+	arenarelease(ar, mark);
+}
+
+// Gather task: copy the elements and the diseases or their codes (if any) of the members of a group
+// to the buffers of its slot
+static void gathergroup(float **elems, float **dise, struct qdise *qd, int *members, int gsize, struct groupwork *w)
+{
+	for (int k = 0; k < gsize; k++)
+		memcpy(w->rows + (size_t)k * NFEAT, elems[members[k]], NFEAT * sizeof(float));
+
+	if (dise != NULL)
+	{
+		for (int k = 0; k < gsize; k++)
+			for (int d = 0; d < TDISEASE; d++)
+				w->dis[(size_t)d * gsize + k] = dise[members[k]][d];
+	}
+	else if (qd != NULL)
+	{
+		for (int k = 0; k < gsize; k++)
+			for (int d = 0; d < TDISEASE; d++)
+				w->qdis[(size_t)d * gsize + k] = qd->code[(size_t)members[k] * TDISEASE + d];
+	}
+}
+
+/* 2 - Function to split the triangle of pairs of a group in tiles of about tilepairs pairs
+   Input:   gsize   number of members of the group
+   Output:  tfirst  first row of each tile: tile t has the pairs (j, k), k > j, of the rows
+                    [tfirst[t], tfirst[t + 1]) (space for gsize + 1 values)
+            returns the number of tiles
+***************************************************************************************************/
+int pairtiles(int gsize, int *tfirst)
+{
+	long pairs = 0;
+	int t = 0;
+
+	tfirst[0] = 0;
+	for (int j = 0; j < gsize; j++)
+	{
+		pairs += gsize - j - 1;
+		if ((pairs >= tilepairs) || (j == gsize - 1))
+		{
+			tfirst[++t] = j + 1;
+			pairs = 0;
+		}
+	}
+	return t;
+}
+
+/* 3 - Function to calculate compactness and medians of every group with tasks
+   Input:   elems    elements (nelems x NFEAT)
+            dise     diseases (nelems x TDISEASE), NULL to get the compactness only
+            qd       quantized diseases, used if dise is NULL (exact codes only)
+            iingrs   size and members of each group
+            ar       arena for the slots and the work of the groups
+   Output:  compact  compactness of each group (vector of size NGROUPS)
+            pairsum  sum of the distances of all the pairs of each group, if not NULL
+            medians  median of each disease in each group (NGROUPS x TDISEASE), for non empty groups
+***************************************************************************************************/
+void analysistasks(float **elems, float **dise, struct qdise *qd, struct gcsr *iingrs, float *compact, double *pairsum, float medians[][TDISEASE], struct arena *ar)
+{
+	size_t mark = arenamark(ar);
+	// in the arena, not on the stack: they grow with NGROUPS
+	struct groupwork *work = arenaalloc(ar, NGROUPS * sizeof(struct groupwork));
+	struct groupwork *slot = arenaalloc(ar, NGROUPS * sizeof(struct groupwork)); // buffers of each slot
+	struct groupsize *order = arenaalloc(ar, NGROUPS * sizeof(struct groupsize));
+	int i, maxprio = omp_get_max_task_priority();
+	int nslots = GROUPSLOTS * omp_get_max_threads();
+
+	// groups from the largest to the smallest: the tasks are created (and started) in this order
+	for (i = 0; i < NGROUPS; i++)
+	{
+		order[i].size = iingrs->size[i];
+		order[i].g = i;
+	}
+	qsort(order, NGROUPS, sizeof(struct groupsize), largerfirst);
+
+	for (i = 0; i < NGROUPS; i++)
+	{
+		work[i].tfirst = (int *)malloc((iingrs->size[i] + 1) * sizeof(int));
+		work[i].ntiles = pairtiles(iingrs->size[i], work[i].tfirst);
+		work[i].tsum = (double *)calloc(work[i].ntiles + 1, sizeof(double));
+	}
+
+	// group o uses slot o % nslots; the groups are in decreasing size, so the first group of each
+	// slot is its largest one
+	if (nslots > NGROUPS)
+		nslots = NGROUPS;
+	memset(slot, 0, nslots * sizeof(struct groupwork));
+	for (i = 0; i < nslots; i++)
+	{
+		size_t gsize = order[i].size;
+
+		slot[i].rows = (float *)arenaalloc(ar, gsize * NFEAT * sizeof(float));
+		if (dise != NULL)
+			slot[i].dis = (float *)arenaalloc(ar, gsize * TDISEASE * sizeof(float));
+		else if (qd != NULL)
+			slot[i].qdis = (unsigned char *)arenaalloc(ar, gsize * TDISEASE);
+	}
+
+	#pragma omp parallel default(none) shared(elems, dise, qd, iingrs, work, slot, nslots, order, medians, maxprio)
+	#pragma omp single
+	{
+		for (int o = 0; o < NGROUPS; o++)
+		{
+			int g = order[o].g, s = o % nslots;
+			struct groupwork *w = &work[g];
+			int gsize = iingrs->size[g], prio;
+
+			if (gsize == 0)
+				continue;
+			// priority of the tasks of the group: from maxprio (the largest group) down to 0
+			prio = (int)((double)maxprio * gsize / order[0].size);
+			w->rows = slot[s].rows;
+			w->dis = slot[s].dis;
+			w->qdis = slot[s].qdis;
+
+			// [*] at most one group in each slot: wait (running other tasks) for the previous group of the
+			// slot, so the dependences of slot[s] are not a list of all the groups created before
+			#pragma omp taskwait depend(inout: slot[s])
+
+			// the slot is free when the tasks of its previous group (in: slot[s]) have finished
+			#pragma omp task default(none) shared(elems, dise, qd, iingrs) firstprivate(g, w, gsize) depend(inout: slot[s]) priority(prio)
+			gathergroup(elems, dise, qd, iingrs->members + iingrs->first[g], gsize, w);
+
+			// [*] compactness tiles: pairs (j, k), k > j, for the rows of the tile
+			for (int t = 0; t < w->ntiles; t++)
+			{
+				#pragma omp task default(none) firstprivate(w, t, gsize) depend(in: slot[s]) priority(prio)
+				{
+					double sum = 0.0;
+					for (int j = w->tfirst[t]; j < w->tfirst[t + 1]; j++)
+						for (int k = j + 1; k < gsize; k++)
+							sum += geneticdistance(w->rows + (size_t)j * NFEAT, w->rows + (size_t)k * NFEAT);
+					w->tsum[t] = sum;
+				}
+			}
+
+			// [*] one median per disease; each task selects in its own part of the buffer
+			for (int d = 0; (dise != NULL) && (d < TDISEASE); d++)
+			{
+				#pragma omp task default(none) shared(medians) firstprivate(w, d, g, gsize) depend(in: slot[s]) priority(prio)
+				medians[g][d] = groupmedian(w->dis + (size_t)d * gsize, gsize);
+			}
+			for (int d = 0; (dise == NULL) && (qd != NULL) && (d < TDISEASE); d++)
+			{
+				#pragma omp task default(none) shared(medians, qd) firstprivate(w, d, g, gsize) depend(in: slot[s]) priority(prio)
+				medians[g][d] = qmedian(w->qdis + (size_t)d * gsize, gsize, qd->book[d]);
+			}
+		}
+	} // implicit barrier: all the tasks are finished
+
+	// compactness: tiles added in order
+	for (i = 0; i < NGROUPS; i++)
+	{
+		int gsize = iingrs->size[i];
+		double comp_aux = 0.0;
+
+		for (int t = 0; t < work[i].ntiles; t++)
+			comp_aux += work[i].tsum[t];
+		if (pairsum != NULL)
+			pairsum[i] = comp_aux;
+		if (gsize <= 1)
+			compact[i] = 0.0;
+		else
+			compact[i] = (float)(comp_aux / ((double)gsize * (gsize - 1) / 2));
+		free(work[i].tfirst);
+		free(work[i].tsum);
+	}
+	arenarelease(ar, mark);
+}
+
+/* 4 - Function to get the maximum and minimum median of each disease
+   Input:   medians  median of each disease in each group
+            iingrs   size of each group (empty groups have no median)
+   Output:  disepro  analysis of the diseases: maximum, minimum of the medians and groups
+***************************************************************************************************/
+void analysemedians(float medians[][TDISEASE], struct gcsr *iingrs, struct analysis *disepro)
+{
+	for (int d = 0; d < TDISEASE; d++)
+	{
+		disepro[d].mmax = FLT_MIN;
+		disepro[d].mmin = FLT_MAX;
+	}
+
+	for (int g = 0; g < NGROUPS; g++)
+		if (iingrs->size[g] > 0)
+			for (int d = 0; d < TDISEASE; d++)
+				updatedisepro(disepro, d, g, medians[g][d]);
+}
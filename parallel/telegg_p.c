@@ -0,0 +1,77 @@
+/*
+CA - OpenMP
+telegg_p.c
+Telemetry of Phase 1 used in gengroups_p.c program (option -l)
+
+A long run prints nothing until the end, so with -l every Lloyd iteration (or one of every N)
+writes one line to a file, a named pipe or stderr ("-"), flushed at once, as CSV or as JSON
+lines (file ending in .json or .jsonl):
+  iteration, wall time since the start of Phase 1, reassignments, maximum shift of a centroid
+  (compared to DELTA to finish) and inertia (sum of the squared distances of the elements to the
+  centroid they were assigned to in the iteration; with weights, as the coreset of -m, each one
+  counts its weight, so it is the objective of that run)
+The values are the ones the iteration already has (the inertia is added while the elements are
+classified), so the cost is one line per iteration, written by the master thread.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+struct telemetry *telemetry = NULL; // telemetry of the iterations of Phase 1 (NULL: not used)
+
+/* 1 - Function to open the telemetry
+   Input:   arg     file[:every]; file "-" is stderr, every is the sampling (one line every N iterations,
+                    and always the last one)
+   Output:  tl      telemetry, started now; returns 0 if it can not be opened
+***************************************************************************************************/
+int teleopen(struct telemetry *tl, char *arg)
+{
+	char *colon = strrchr(arg, ':');
+	size_t len;
+
+	tl->every = 1;
+	if ((colon != NULL) && (atoi(colon + 1) > 0))
+	{
+		tl->every = atoi(colon + 1);
+		*colon = '\0';
+	}
+	len = strlen(arg);
+	tl->json = ((len > 5) && (strcmp(arg + len - 5, ".json") == 0)) || ((len > 6) && (strcmp(arg + len - 6, ".jsonl") == 0));
+	tl->f = (strcmp(arg, "-") == 0) ? stderr : fopen(arg, "w");
+	if (tl->f == NULL)
+		return 0;
+	if (!tl->json)
+		fprintf(tl->f, "iter,time_s,reassignments,max_shift,delta,inertia\n");
+	fflush(tl->f);
+	tl->t0 = omp_get_wtime();
+	return 1;
+}
+
+/* 2 - Function to write the line of one iteration (if it is sampled)
+   Input:   niter   iteration (from 1)
+            nchanges, maxshift, inertia: values of the iteration
+            last    1 if it is the last iteration (always written)
+***************************************************************************************************/
+void teleline(struct telemetry *tl, int niter, int nchanges, double maxshift, double inertia, int last)
+{
+	double t = omp_get_wtime() - tl->t0;
+
+	if ((niter % tl->every != 0) && !last)
+		return;
+	if (tl->json)
+		fprintf(tl->f, "{\"iter\": %d, \"time_s\": %.6f, \"reassignments\": %d, \"max_shift\": %.6g, \"delta\": %g, \"inertia\": %.9g}\n",
+				niter, t, nchanges, maxshift, DELTA, inertia);
+	else
+		fprintf(tl->f, "%d,%.6f,%d,%.6g,%g,%.9g\n", niter, t, nchanges, maxshift, DELTA, inertia);
+	fflush(tl->f);
+}
+
+void teleclose(struct telemetry *tl)
+{
+	if (tl->f != stderr)
+		fclose(tl->f);
+}
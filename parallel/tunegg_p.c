@@ -0,0 +1,246 @@
+/*
+CA - OpenMP
+tunegg_p.c
+Autotuning of the schedules and thread counts used in gengroups_p.c program (option -t)
+
+The best schedule and number of threads depend on the machine and on the size of the data, so
+a short calibration on the first TUNESAMPLE elements tries, for each phase:
+  - Phase 1 (lloyd): schedule kind and chunk of the classification loop, then number of threads,
+    timing TUNEIT iterations from the usual first centroids
+  - members of the groups (counting sort): number of threads (the schedule must stay static)
+  - compactness and medians (task graph): size of the tiles, then number of threads
+Each candidate is run twice and the fastest time is kept. The best configuration is saved in
+TUNEFILE, one line per host and data shape (number of elements rounded up to a power of 2,
+features, groups and maximum number of threads), and it is applied automatically by the next
+runs with the same key.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+static char *schedname[] = {"", "static", "dynamic", "guided", "auto"};
+
+// Key of the tuning file: host and shape of the data
+static void tunekey(char *key, size_t size, int nelems, int nthr)
+{
+	char host[256];
+	int shape = 0;
+
+	if (gethostname(host, sizeof(host)) != 0)
+		strcpy(host, "unknown");
+	host[sizeof(host) - 1] = '\0';
+	while ((1 << shape) < nelems)
+		shape++;
+	snprintf(key, size, "%s 2^%d %d %d %d", host, shape, NFEAT, NGROUPS, nthr);
+}
+
+// Best time of two runs of one phase with the configuration in tu
+static double timephase(int phase, int n, float **elems, gindex *grind, struct gcsr *iingrs,
+						struct arena *ar, struct arena *scratch, struct tuning *tu)
+{
+	size_t mark = arenamark(ar);
+	float (*cent)[NFEAT] = arenaalloc(ar, NGROUPS * sizeof(*cent));
+	float *compact = (float *)arenaalloc(ar, NGROUPS * sizeof(float));
+	struct lloydstats ls;
+	double t, best = 1e30;
+
+	for (int rep = 0; rep < 2; rep++)
+	{
+		if (phase == 0)
+		{
+			initcentroids(cent, 147);
+			omp_set_num_threads(tu->clusthr);
+			omp_set_schedule(tu->clussched, tu->cluschunk);
+			t = omp_get_wtime();
+			lloyd(n, elems, cent, grind, &ls, scratch, TUNEIT, NULL, NULL, NULL);
+		}
+		else if (phase == 1)
+		{
+			omp_set_num_threads(tu->orgthr);
+			t = omp_get_wtime();
+			groupmembers(n, grind, iingrs, ar);
+		}
+		else
+		{
+			omp_set_num_threads(tu->compthr);
+			tilepairs = tu->tilepairs;
+			t = omp_get_wtime();
+			analysistasks(elems, NULL, NULL, iingrs, compact, NULL, NULL, ar);
+		}
+		t = omp_get_wtime() - t;
+		if (t < best)
+			best = t;
+	}
+	arenarelease(ar, mark);
+	return best;
+}
+
+// Try the values of one parameter (*param = val[c]) and keep the fastest one
+static void tryvalues(int phase, int *param, int *val, int nval, int n, float **elems, gindex *grind,
+					  struct gcsr *iingrs, struct arena *ar, struct arena *scratch, struct tuning *tu)
+{
+	double t, best = 1e30;
+	int bestval = *param;
+
+	for (int c = 0; c < nval; c++)
+	{
+		*param = val[c];
+		t = timephase(phase, n, elems, grind, iingrs, ar, scratch, tu);
+		if (t < best)
+		{
+			best = t;
+			bestval = val[c];
+		}
+	}
+	*param = bestval;
+}
+
+/* 1 - Function to set the configuration used without tuning (as the fixed version)
+***************************************************************************************************/
+void tunedefault(struct tuning *tu, int nthr)
+{
+	tu->clusthr = tu->orgthr = tu->compthr = nthr;
+	tu->clussched = omp_sched_static;
+	tu->cluschunk = 0;
+	tu->tilepairs = TILEPAIRS;
+}
+
+/* 2 - Functions to read and write the configuration of this host and data shape in the tuning file
+   Input:   fname   tuning file
+            nelems  number of elements
+            nthr    maximum number of threads
+   Output:  tu      configuration (tuneload: only changed if the key is found, and returns 1)
+***************************************************************************************************/
+int tuneload(char *fname, int nelems, int nthr, struct tuning *tu)
+{
+	char key[512], line[1024];
+	size_t len;
+	struct tuning t;
+	FILE *f;
+	int found = 0;
+
+	tunekey(key, sizeof(key), nelems, nthr);
+	len = strlen(key);
+	f = fopen(fname, "r");
+	if (f == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), f) != NULL)
+		if ((strncmp(line, key, len) == 0) && (line[len] == ':') &&
+			(sscanf(line + len + 1, "%d %d %d %d %d %d", &t.clusthr, &t.clussched, &t.cluschunk,
+					&t.orgthr, &t.compthr, &t.tilepairs) == 6) &&
+			(t.clusthr >= 1) && (t.clusthr <= nthr) && (t.orgthr >= 1) && (t.orgthr <= nthr) &&
+			(t.compthr >= 1) && (t.compthr <= nthr) && (t.tilepairs > 0) &&
+			(t.clussched >= omp_sched_static) && (t.clussched <= omp_sched_auto))
+		{
+			*tu = t;
+			found = 1;
+		}
+	fclose(f);
+	return found;
+}
+
+void tunesave(char *fname, int nelems, int nthr, struct tuning *tu)
+{
+	char key[512], line[1024], tmp[4096];
+	size_t len;
+	FILE *f, *g;
+
+	tunekey(key, sizeof(key), nelems, nthr);
+	len = strlen(key);
+	snprintf(tmp, sizeof(tmp), "%s.tmp", fname);
+	g = fopen(tmp, "w");
+	if (g == NULL)
+	{
+		printf("Error when opening file %s \n", tmp);
+		return;
+	}
+
+	// the other keys are kept, the line of this key is replaced
+	f = fopen(fname, "r");
+	if (f != NULL)
+	{
+		while (fgets(line, sizeof(line), f) != NULL)
+			if ((strncmp(line, key, len) != 0) || (line[len] != ':'))
+				fputs(line, g);
+		fclose(f);
+	}
+	fprintf(g, "%s: %d %d %d %d %d %d\n", key, tu->clusthr, tu->clussched, tu->cluschunk,
+			tu->orgthr, tu->compthr, tu->tilepairs);
+	fclose(g);
+	rename(tmp, fname);
+}
+
+/* 3 - Function to find the best configuration of each phase on a sample of the elements
+   Input:   nelems  number of elements
+            elems   matrix of elements (nelems x NFEAT)
+            nthr    maximum number of threads (scratch has nthr sub-arenas)
+            iingrs, ar, scratch: workspace, as for the real phases
+   Output:  tu      best configuration
+***************************************************************************************************/
+void tune(int nelems, float **elems, int nthr, struct gcsr *iingrs, struct arena *ar,
+		  struct arena *scratch, struct tuning *tu)
+{
+	int n = (nelems < TUNESAMPLE) ? nelems : TUNESAMPLE;
+	int thr[32], nt = 0, sched[5], chunk[5], tiles[4], k;
+	size_t mark = arenamark(ar);
+	gindex *grind = (gindex *)arenaalloc(ar, n * sizeof(gindex));
+
+	// thread counts: powers of 2 and the maximum
+	for (k = 1; k < nthr; k *= 2)
+		thr[nt++] = k;
+	thr[nt++] = nthr;
+
+	tunedefault(tu, nthr);
+
+	// Phase 1: schedules with all the threads, then threads with the best schedule
+	sched[0] = omp_sched_static;  chunk[0] = 0;
+	sched[1] = omp_sched_static;  chunk[1] = 1024;
+	sched[2] = omp_sched_dynamic; chunk[2] = 256;
+	sched[3] = omp_sched_dynamic; chunk[3] = 4096;
+	sched[4] = omp_sched_guided;  chunk[4] = 256;
+	{
+		double t, best = 1e30;
+		int bests = 0;
+
+		for (k = 0; k < 5; k++)
+		{
+			tu->clussched = sched[k];
+			tu->cluschunk = chunk[k];
+			t = timephase(0, n, elems, grind, iingrs, ar, scratch, tu);
+			if (t < best)
+			{
+				best = t;
+				bests = k;
+			}
+		}
+		tu->clussched = sched[bests];
+		tu->cluschunk = chunk[bests];
+	}
+	tryvalues(0, &tu->clusthr, thr, nt, n, elems, grind, iingrs, ar, scratch, tu);
+
+	// members: threads (grind is the classification of the last run of Phase 1)
+	tryvalues(1, &tu->orgthr, thr, nt, n, elems, grind, iingrs, ar, scratch, tu);
+
+	// compactness: size of the tiles with all the threads, then threads
+	for (k = 0; k < 4; k++)
+		tiles[k] = (TILEPAIRS / 16) << (2 * k);
+	tryvalues(2, &tu->tilepairs, tiles, 4, n, elems, grind, iingrs, ar, scratch, tu);
+	tryvalues(2, &tu->compthr, thr, nt, n, elems, grind, iingrs, ar, scratch, tu);
+
+	arenarelease(ar, mark);
+	omp_set_num_threads(nthr);
+}
+
+/* 4 - Function to print a configuration
+***************************************************************************************************/
+void tuneprint(struct tuning *tu)
+{
+	printf("\n    Phase 1:  %d threads, schedule(%s, %d)", tu->clusthr, schedname[tu->clussched & 0xff], tu->cluschunk);
+	printf("\n    Members:  %d threads", tu->orgthr);
+	printf("\n    Analysis: %d threads, tiles of %d distances", tu->compthr, tu->tilepairs);
+}
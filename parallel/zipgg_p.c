@@ -0,0 +1,298 @@
+/*
+CA - OpenMP
+zipgg_p.c
+Compressed input files used in gengroups_p.c program (dbgen/dbdise ending in .gz or .zst)
+
+The input files are opened with zopen instead of fopen, and the result is a normal FILE *, so
+fscanf parses the numbers as they are decompressed, without an intermediate file:
+  - BGZF (gzip made of independent blocks of up to 64 KB, as written by bgzip): the file is
+    mapped, the blocks are found from their headers, and batches of ZBLOCKS blocks are
+    inflated in parallel, each block in its own place of the output buffer
+  - any other gzip (one or more members): inflated sequentially, it can not be split
+  - zstd: decompressed by the zstd program through a pipe (zstd -dc)
+Other files are opened with fopen as before.
+*/
+
+#define _GNU_SOURCE // fopencookie
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <omp.h>
+#include "../shared/definegg.h" // definition of constants
+#include "fungg_p.h"
+
+#define BGZFMAX 65536	//maximum uncompressed size of a BGZF block
+
+struct zinput              // decompression state behind the FILE * of zopen
+{
+ unsigned char *map;       // compressed file, mapped
+ size_t   mapsize;
+ size_t  *boff;            // BGZF: offset of each block (nblocks + 1 values); NULL: sequential gzip
+ int      nblocks, next;   // BGZF: number of blocks and first block not inflated yet
+ z_stream zs;              // sequential gzip, and compressed bytes not given to zlib yet
+ size_t   inleft;
+ int      zstd;            // zstd: decompressed by the zstd program
+ FILE    *pipe;            // its output (NULL when it has finished)
+ char    *out;             // decompressed data not read yet: out[outpos .. outlen)
+ size_t   outlen, outpos, outsize;
+};
+
+// Size of the BGZF block that starts at p (0 if it is not a BGZF block)
+static size_t bgzfblock(unsigned char *p, size_t left)
+{
+	size_t xlen, i;
+
+	if ((left < 18) || (p[0] != 31) || (p[1] != 139) || (p[2] != 8) || !(p[3] & 4))
+		return 0;
+	xlen = p[10] | (p[11] << 8);
+	for (i = 12; (i + 6 <= 12 + xlen) && (i + 6 <= left); i += 4 + (p[i + 2] | (p[i + 3] << 8)))
+		if ((p[i] == 'B') && (p[i + 1] == 'C') && (p[i + 2] == 2) && (p[i + 3] == 0))
+		{
+			size_t bsize = (size_t)(p[i + 4] | (p[i + 5] << 8)) + 1;
+			return (bsize >= 12 + xlen + 8) ? bsize : 0;
+		}
+	return 0;
+}
+
+// Inflate the next ZBLOCKS BGZF blocks, in parallel
+static void bgzfbatch(struct zinput *z)
+{
+	int first = z->next, n = z->nblocks - z->next;
+	size_t outoff[ZBLOCKS + 1];
+
+	if (n > ZBLOCKS)
+		n = ZBLOCKS;
+
+	// the uncompressed size of each block is in its last 4 bytes (ISIZE)
+	outoff[0] = 0;
+	for (int b = 0; b < n; b++)
+	{
+		unsigned char *t = z->map + z->boff[first + b + 1] - 4;
+		size_t isize = t[0] | (t[1] << 8) | (t[2] << 16) | ((size_t)t[3] << 24);
+
+		if (isize > BGZFMAX)
+		{
+			printf("Error: corrupted BGZF block %d \n", first + b);
+			exit(-1);
+		}
+		outoff[b + 1] = outoff[b] + isize;
+	}
+
+	// [*] the blocks are independent, each one is inflated by one thread; dynamic: their sizes differ
+	#pragma omp parallel for default(none) shared(z, first, n, outoff) schedule(dynamic)
+	for (int b = 0; b < n; b++)
+	{
+		unsigned char *p = z->map + z->boff[first + b];
+		size_t bsize = z->boff[first + b + 1] - z->boff[first + b];
+		size_t hsize = 12 + (p[10] | (p[11] << 8));
+		unsigned char *t = p + bsize - 8;
+		z_stream zs;
+		int ret;
+
+		memset(&zs, 0, sizeof(zs));
+		inflateInit2(&zs, -15); // raw deflate data between the header and the trailer
+		zs.next_in = p + hsize;
+		zs.avail_in = bsize - hsize - 8;
+		zs.next_out = (unsigned char *)z->out + outoff[b];
+		zs.avail_out = outoff[b + 1] - outoff[b];
+		ret = inflate(&zs, Z_FINISH);
+		inflateEnd(&zs);
+		if ((ret != Z_STREAM_END) || (zs.avail_out != 0) ||
+			(crc32(0, (unsigned char *)z->out + outoff[b], outoff[b + 1] - outoff[b]) !=
+			 (t[0] | (t[1] << 8) | (t[2] << 16) | ((unsigned long)t[3] << 24))))
+		{
+			printf("Error: corrupted BGZF block %d \n", first + b);
+			exit(-1);
+		}
+	}
+
+	z->next += n;
+	z->outlen = outoff[n];
+	z->outpos = 0;
+}
+
+// End of the zstd pipe: a read error, or zstd finished with an error (corrupted or truncated file);
+// early: the pipe is closed before the end, so zstd can be stopped by SIGPIPE (128 + 13 from the shell)
+static int zstdend(struct zinput *z, int early)
+{
+	int err = ferror(z->pipe), status = pclose(z->pipe);
+
+	z->pipe = NULL;
+	if (early && ((WIFSIGNALED(status) && (WTERMSIG(status) == SIGPIPE)) || (WIFEXITED(status) && (WEXITSTATUS(status) == 128 + SIGPIPE))))
+		return 0;
+	if (err || (status == -1) || (WIFEXITED(status) && (WEXITSTATUS(status) != 0)))
+	{
+		printf("Error: corrupted or truncated zstd file (zstd exit status %d) \n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		exit(-1);
+	}
+	return 0;
+}
+
+// Inflate the next part of a sequential gzip file (members one after the other)
+static void gzipnext(struct zinput *z)
+{
+	int ret;
+
+	z->zs.next_out = (unsigned char *)z->out;
+	z->zs.avail_out = z->outsize;
+	while ((z->zs.avail_out == z->outsize) && ((z->zs.avail_in > 0) || (z->inleft > 0)))
+	{
+		// avail_in is 32 bits: big files are given in pieces
+		if (z->zs.avail_in == 0)
+		{
+			z->zs.avail_in = (z->inleft < (1u << 30)) ? z->inleft : (1u << 30);
+			z->inleft -= z->zs.avail_in;
+		}
+		ret = inflate(&z->zs, Z_NO_FLUSH);
+		if (ret == Z_STREAM_END)
+			inflateReset(&z->zs); // next member, if any
+		else if (ret != Z_OK)
+		{
+			printf("Error: corrupted gzip file (%s) \n", z->zs.msg ? z->zs.msg : "");
+			exit(-1);
+		}
+	}
+	// total_in starts again with every member: a member without its end is a truncated file
+	if ((z->zs.avail_in == 0) && (z->inleft == 0) && (z->zs.total_in > 0))
+	{
+		printf("Error: truncated gzip file \n");
+		exit(-1);
+	}
+	z->outlen = z->outsize - z->zs.avail_out;
+	z->outpos = 0;
+}
+
+static ssize_t zread(void *cookie, char *buf, size_t size)
+{
+	struct zinput *z = (struct zinput *)cookie;
+	size_t n;
+
+	if (z->zstd)
+	{
+		// the whole output is read: the pipe is closed here, so a bad file is found before it is used
+		if ((z->pipe == NULL) || ((n = fread(buf, 1, size, z->pipe)) == 0))
+			return (z->pipe == NULL) ? 0 : zstdend(z, 0);
+		return n;
+	}
+
+	while (z->outpos == z->outlen)
+	{
+		if ((z->boff != NULL) && (z->next < z->nblocks))
+			bgzfbatch(z);
+		else if ((z->boff == NULL) && ((z->zs.avail_in > 0) || (z->inleft > 0)))
+			gzipnext(z);
+		else
+			return 0; // end of file
+	}
+
+	n = z->outlen - z->outpos;
+	if (n > size)
+		n = size;
+	memcpy(buf, z->out + z->outpos, n);
+	z->outpos += n;
+	return n;
+}
+
+static int zclose(void *cookie)
+{
+	struct zinput *z = (struct zinput *)cookie;
+
+	if (z->zstd)
+	{
+		// closed before the end (only the first elements are read)
+		if (z->pipe != NULL)
+			zstdend(z, 1);
+	}
+	else
+	{
+		if (z->boff == NULL)
+			inflateEnd(&z->zs);
+		munmap(z->map, z->mapsize);
+	}
+	free(z->boff);
+	free(z->out);
+	free(z);
+	return 0;
+}
+
+/* 1 - Function to open an input file, compressed or not
+   Input:   fname   file name; .gz: gzip (BGZF in parallel), .zst: zstd, other: text
+   Output:  file open for reading with fscanf, to be closed with fclose; NULL if it can not be opened
+***************************************************************************************************/
+FILE *zopen(char *fname)
+{
+	cookie_io_functions_t io = {zread, NULL, NULL, zclose};
+	size_t len = strlen(fname), off, bsize;
+	struct zinput *z;
+	struct stat sb;
+	char cmd[4200];
+	int fd;
+
+	if ((len > 4) && (strcmp(fname + len - 4, ".zst") == 0))
+	{
+		// no zstd library here: the zstd program decompresses, and this process parses meanwhile
+		if ((strchr(fname, '\'') != NULL) || (access(fname, R_OK) != 0))
+			return NULL;
+		z = (struct zinput *)calloc(1, sizeof(struct zinput));
+		z->zstd = 1;
+		snprintf(cmd, sizeof(cmd), "zstd -dc -- '%s'", fname);
+		z->pipe = popen(cmd, "r");
+		if (z->pipe == NULL)
+		{
+			free(z);
+			return NULL;
+		}
+		return fopencookie(z, "r", io);
+	}
+
+	if ((len <= 3) || (strcmp(fname + len - 3, ".gz") != 0))
+		return fopen(fname, "r");
+
+	fd = open(fname, O_RDONLY);
+	if ((fd < 0) || (fstat(fd, &sb) != 0) || (sb.st_size == 0))
+		return NULL;
+	z = (struct zinput *)calloc(1, sizeof(struct zinput));
+	z->mapsize = sb.st_size;
+	z->map = mmap(NULL, z->mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (z->map == MAP_FAILED)
+	{
+		free(z);
+		return NULL;
+	}
+	madvise(z->map, z->mapsize, MADV_SEQUENTIAL);
+
+	// BGZF if every block has its size in the header, and the blocks end exactly at the end of the file
+	for (off = 0; (off < z->mapsize) && ((bsize = bgzfblock(z->map + off, z->mapsize - off)) > 0) && (off + bsize <= z->mapsize); off += bsize)
+	{
+		if (z->nblocks % 1024 == 0)
+			z->boff = (size_t *)realloc(z->boff, (z->nblocks + 1025) * sizeof(size_t));
+		z->boff[z->nblocks++] = off;
+	}
+
+	if ((z->nblocks > 0) && (off == z->mapsize))
+	{
+		z->boff[z->nblocks] = off;
+		z->outsize = (size_t)ZBLOCKS * BGZFMAX;
+	}
+	else
+	{
+		free(z->boff);
+		z->boff = NULL;
+		z->nblocks = 0;
+		inflateInit2(&z->zs, 15 + 16); // gzip header
+		z->zs.next_in = z->map;
+		z->inleft = z->mapsize;
+		z->outsize = (size_t)1 << 20;
+	}
+	z->out = (char *)malloc(z->outsize);
+
+	return fopencookie(z, "r", io);
+}
@@ -0,0 +1,8 @@
+/*
+   fungg_s.h
+   headers of the functions used only in the serial version (gengroups_s.c)
+***************************************************************/
+
+extern void closestgroup(int nelem, float **elem, float cent[][NFEAT], int *grind);
+extern void groupcompactness(float **elem, struct ginfo *iingrs, float *compact);
+extern void diseases(int nelems, struct ginfo *iingrs, float **dise, struct analysis *disepro);
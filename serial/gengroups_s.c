@@ -18,6 +18,7 @@
 
 #include "../shared/definegg.h"
 #include "../shared/fungg.h"
+#include "fungg_s.h"
 
 float **elems;				  // matrix to keep information about every element
 struct ginfo iingrs[NGROUPS]; // vector to store information about each group: members and size
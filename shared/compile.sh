@@ -12,8 +12,8 @@ then
     elif [[ $1 == "p" ]];
     then
         echo "[*] Compiling parallel program [*]"
-        echo "gcc -O2 -fopenmp -lm -o ~/genetics/parallel/gengroups_p ~/genetics/parallel/gengroups_p.c ~/genetics/parallel/fungg_p.c"
-        gcc -O2 -fopenmp -lm -o ~/genetics/parallel/gengroups_p ~/genetics/parallel/gengroups_p.c ~/genetics/parallel/fungg_p.c
+        echo "gcc -O2 -fopenmp -pthread -o ~/genetics/parallel/gengroups_p ~/genetics/parallel/*.c -lm -lz"
+        gcc -O2 -fopenmp -pthread -o ~/genetics/parallel/gengroups_p ~/genetics/parallel/*.c -lm -lz
     else
         echo "Invalid compile mode $1"
     fi